@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# HiPerC: High Performance Computing Strategies for Boundary Value Problems
+# written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+#
+# This software was developed at the National Institute of Standards and Technology
+# by employees of the Federal Government in the course of their official duties.
+# Pursuant to title 17 section 105 of the United States Code this software is not
+# subject to copyright protection and is in the public domain. NIST assumes no
+# responsibility whatsoever for the use of this software by other parties, and makes
+# no guarantees, expressed or implied, about its quality, reliability, or any other
+# characteristic. We would appreciate acknowledgement if the software is used.
+#
+# This software can be redistributed and/or modified freely provided that any
+# derivative works bear some notice that they are derived from it, and any modified
+# versions bear some notice that they have been modified.
+#
+# Questions/comments to Trevor Keller (trevor.keller@nist.gov)
+
+# This script will build the Hedgehog diffusion program twice, with and without
+# the per-step barrier (-DSTEP_BARRIER=ON), and run both on the same parameter
+# file. The wait-time profiles written by each run, `post-exec-wait.dot` and
+# `post-exec-barrier-wait.dot`, are rendered side by side as
+# `hedgehog-wait.png` and `hedgehog-barrier-wait.png` in this directory, along
+# with each run's `runlog` as `hedgehog_<mode>.csv`.
+#
+# Usage: ./hedgehog-wait-experiment.sh /path/to/Hedgehog/src [params.txt]
+
+if [[ $# -lt 1 ]]
+then
+	echo "Usage: $0 /path/to/Hedgehog/src [params.txt]"
+	exit 1
+fi
+
+DATADIR=$(pwd)
+HHDIR=$(cd "$1" && pwd)
+SRCDIR=$(cd `dirname "${DATADIR}"`/cpu-hedgehog-diffusion && pwd)
+PARAMS=$(readlink -f "${2:-${SRCDIR}/../common-diffusion/params.txt}")
+
+for MODE in wait barrier-wait
+do
+	BUILD=${SRCDIR}/build-${MODE}
+	[[ ${MODE} == barrier-wait ]] && BARRIER=ON || BARRIER=OFF
+
+	mkdir -p ${BUILD}
+	cmake -S ${SRCDIR} -B ${BUILD} -DHedgehog_INCLUDE_DIR=${HHDIR} \
+	      -DCMAKE_BUILD_TYPE=Release -DSTEP_BARRIER=${BARRIER} || exit 1
+	cmake --build ${BUILD} || exit 1
+
+	echo "Running with STEP_BARRIER=${BARRIER}"
+	(cd ${BUILD} && ./diffusion_Hedgehog ${PARAMS}) || exit 1
+
+	dot -Tpng ${BUILD}/post-exec-${MODE}.dot -o ${DATADIR}/hedgehog-${MODE}.png
+	mv ${BUILD}/runlog.csv ${DATADIR}/hedgehog_${MODE}.csv
+	tail -n 1 ${DATADIR}/hedgehog_${MODE}.csv
+	echo
+done
@@ -0,0 +1,124 @@
+#!/usr/bin/python
+# coding: utf-8
+
+# ***********************************************************************************
+# HiPerC: High Performance Computing Strategies for Boundary Value Problems
+# written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+# This software was developed at the National Institute of Standards and Technology
+# by employees of the Federal Government in the course of their official duties.
+# Pursuant to title 17 section 105 of the United States Code this software is not
+# subject to copyright protection and is in the public domain. NIST assumes no
+# responsibility whatsoever for the use of this software by other parties, and makes
+# no guarantees, expressed or implied, about its quality, reliability, or any other
+# characteristic. We would appreciate acknowledgement if the software is used.
+# This software can be redistributed and/or modified freely provided that any
+# derivative works bear some notice that they are derived from it, and any modified
+# versions bear some notice that they have been modified.
+# Questions/comments to Trevor Keller (trevor.keller@nist.gov)
+# ***********************************************************************************
+
+# Usage: python read_checkpoint.py diffusion.0001000.dat
+# or, from another script: from read_checkpoint import read_checkpoint
+
+# Reads raw and compressed checkpoints written by write_checkpoint() in
+# common-*/output.c. See struct Checkpoint and struct CheckpointTiles in
+# common-*/output.h for the layout.
+
+import struct
+import zlib
+import numpy as np
+from sys import argv
+
+CODEC_RAW = 0
+CODEC_QUANTIZED = 1
+
+
+def varints(codes):
+    """Decode a byte string of varints, without escapes, to unsigned integers"""
+    b = np.frombuffer(codes, dtype=np.uint8).astype(np.uint64)
+    last = np.flatnonzero(b < 0x80)
+    first = np.concatenate(([0], last[:-1] + 1))
+    values = np.zeros(len(last), dtype=np.uint64)
+    for shift in range(10):
+        index = first + shift
+        inside = index <= last
+        if not inside.any():
+            break
+        values[inside] |= (b[index[inside]] & 0x7f) << np.uint64(7 * shift)
+    return values
+
+
+def decode_tile(codes, w, h, quantum, fp):
+    """Rebuild one tile of a CODEC_QUANTIZED checkpoint"""
+    tile = np.empty((h, w), dtype=fp)
+    if b"\x00" not in codes:
+        # no verbatim values: the Lorenzo predictor inverts to a 2D running sum
+        z = varints(codes) - np.uint64(1)
+        r = np.where(z & np.uint64(1), -((z + np.uint64(1)) // np.uint64(2)).astype(np.int64),
+                     (z // np.uint64(2)).astype(np.int64))
+        k = np.cumsum(np.cumsum(r.reshape(h, w), axis=0), axis=1)
+        tile[:] = k * quantum
+        return tile
+
+    k = np.zeros((h, w), dtype=np.int64)
+    n = 0
+    for j in range(h):
+        for i in range(w):
+            shift = z = 0
+            while True:
+                byte = ord(codes[n:n+1])
+                n += 1
+                z |= (byte & 0x7f) << shift
+                shift += 7
+                if byte < 0x80:
+                    break
+            if z == 0:
+                tile[j, i] = np.frombuffer(codes[n:n+fp.itemsize], dtype=fp)[0]
+                n += fp.itemsize
+                continue
+            z -= 1
+            r = -((z + 1) // 2) if z & 1 else z // 2
+            west = k[j, i-1] if i > 0 else 0
+            north = k[j-1, i] if j > 0 else 0
+            northwest = k[j-1, i-1] if (i > 0 and j > 0) else 0
+            k[j, i] = r + west + north - northwest
+            tile[j, i] = k[j, i] * quantum
+    return tile
+
+
+def read_checkpoint(name):
+    """Return the field, halo included, and a dict of header values"""
+    with open(name, "rb") as f:
+        data = f.read()
+
+    magic, version, width, nx, ny, nm, codec, dx, dy, elapsed, step = \
+        struct.unpack("=8s6i3dq", data[:64])
+    if magic != b"HiPerC\x1a\n" or version != 1:
+        raise ValueError("{0} is not a version 1 checkpoint".format(name))
+    fp = np.dtype("f{0}".format(width))
+    header = dict(nx=nx, ny=ny, nm=nm, dx=dx, dy=dy, elapsed=elapsed, step=step)
+
+    if codec == CODEC_RAW:
+        return np.frombuffer(data, dtype=fp, count=nx*ny, offset=64).reshape(ny, nx), header
+
+    tolerance, size, ntiles = struct.unpack("=d2i", data[64:80])
+    sizes = np.frombuffer(data, dtype=np.uint64, count=ntiles, offset=80)
+    offset = 80 + 8 * ntiles
+    tx = (nx + size - 1) // size
+    conc = np.empty((ny, nx), dtype=fp)
+    for t in range(ntiles):
+        i0, j0 = size * (t % tx), size * (t // tx)
+        i1, j1 = min(i0 + size, nx), min(j0 + size, ny)
+        codes = zlib.decompress(data[offset:offset + int(sizes[t])])
+        conc[j0:j1, i0:i1] = decode_tile(codes, i1 - i0, j1 - j0, 2.0 * tolerance, fp)
+        offset += int(sizes[t])
+    header["tolerance"] = tolerance
+    return conc, header
+
+
+if __name__ == "__main__":
+    for name in argv[1:]:
+        conc, header = read_checkpoint(name)
+        print("{0}: step {1}, t={2}, {3}x{4}, c in [{5}, {6}]".format(
+              name, header["step"], header["elapsed"], header["nx"], header["ny"],
+              conc.min(), conc.max()))
@@ -0,0 +1,174 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  affinity.c
+ \brief Implementation of thread-pinning functions for threaded diffusion benchmarks
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "affinity.h"
+
+/**
+ \brief Location of one CPU in the node
+*/
+struct cpu_slot {
+	int cpu;     /**< operating-system CPU number */
+	int package; /**< socket */
+	int core;    /**< physical core within the socket */
+	int smt;     /**< hyperthread index within the core */
+	int rank;    /**< position within the socket, cores before hyperthreads */
+};
+
+static enum pin_layout layout = PIN_NONE;
+
+static int ncpus = 0;
+
+static int cpu_order[CPU_SETSIZE];
+
+/**
+ \brief Read one integer from a sysfs topology file, or -1 if unavailable
+*/
+static int read_topology(const int cpu, const char* name)
+{
+	char path[128];
+	int value = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+	FILE* input = fopen(path, "r");
+	if (input != NULL) {
+		if (fscanf(input, "%d", &value) != 1)
+			value = -1;
+		fclose(input);
+	}
+
+	return value;
+}
+
+static int by_package_core(const void* a, const void* b)
+{
+	const struct cpu_slot* x = (const struct cpu_slot*)a;
+	const struct cpu_slot* y = (const struct cpu_slot*)b;
+
+	if (x->package != y->package)
+		return x->package - y->package;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->cpu - y->cpu;
+}
+
+static int by_package_smt_core(const void* a, const void* b)
+{
+	const struct cpu_slot* x = (const struct cpu_slot*)a;
+	const struct cpu_slot* y = (const struct cpu_slot*)b;
+
+	if (x->package != y->package)
+		return x->package - y->package;
+	if (x->smt != y->smt)
+		return x->smt - y->smt;
+	if (x->core != y->core)
+		return x->core - y->core;
+	return x->cpu - y->cpu;
+}
+
+static int by_rank_package(const void* a, const void* b)
+{
+	const struct cpu_slot* x = (const struct cpu_slot*)a;
+	const struct cpu_slot* y = (const struct cpu_slot*)b;
+
+	if (x->rank != y->rank)
+		return x->rank - y->rank;
+	return x->package - y->package;
+}
+
+void affinity_init()
+{
+	static struct cpu_slot slots[CPU_SETSIZE];
+	const char* env = getenv("HIPERC_PIN");
+	cpu_set_t mask;
+
+	layout = PIN_NONE;
+	ncpus = 0;
+
+	if (env == NULL || strcmp(env, "none") == 0)
+		return;
+	else if (strcmp(env, "compact") == 0)
+		layout = PIN_COMPACT;
+	else if (strcmp(env, "scatter") == 0)
+		layout = PIN_SCATTER;
+	else {
+		printf("Warning: unknown HIPERC_PIN layout %s. Threads will not be pinned.\n", env);
+		return;
+	}
+
+	if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+		printf("Warning: unable to read CPU affinity. Threads will not be pinned.\n");
+		layout = PIN_NONE;
+		return;
+	}
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &mask)) {
+			slots[ncpus].cpu = cpu;
+			slots[ncpus].package = read_topology(cpu, "physical_package_id");
+			slots[ncpus].core = read_topology(cpu, "core_id");
+			ncpus++;
+		}
+	}
+
+	/* number hyperthreads within each core */
+	qsort(slots, ncpus, sizeof(struct cpu_slot), by_package_core);
+	for (int n = 0; n < ncpus; n++) {
+		const int same = (n > 0 && slots[n].package == slots[n-1].package && slots[n].core == slots[n-1].core);
+		slots[n].smt = same ? slots[n-1].smt + 1 : 0;
+	}
+
+	if (layout == PIN_SCATTER) {
+		/* rank CPUs within each socket, then deal one from each socket in turn */
+		qsort(slots, ncpus, sizeof(struct cpu_slot), by_package_smt_core);
+		for (int n = 0; n < ncpus; n++) {
+			const int same = (n > 0 && slots[n].package == slots[n-1].package);
+			slots[n].rank = same ? slots[n-1].rank + 1 : 0;
+		}
+		qsort(slots, ncpus, sizeof(struct cpu_slot), by_rank_package);
+	}
+
+	for (int n = 0; n < ncpus; n++)
+		cpu_order[n] = slots[n].cpu;
+}
+
+void pin_thread(const int thread)
+{
+	cpu_set_t mask;
+
+	if (layout == PIN_NONE || ncpus == 0)
+		return;
+
+	CPU_ZERO(&mask);
+	CPU_SET(cpu_order[thread % ncpus], &mask);
+
+	if (sched_setaffinity(0, sizeof(mask), &mask) != 0)
+		printf("Warning: unable to pin thread %d to CPU %d.\n", thread, cpu_order[thread % ncpus]);
+}
+
+const char* thread_placement()
+{
+	switch(layout) {
+		case PIN_COMPACT:
+			return "pin=compact";
+		case PIN_SCATTER:
+			return "pin=scatter";
+		default:
+			return "pin=none";
+	}
+}
@@ -0,0 +1,52 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  affinity.h
+ \brief Declaration of thread-pinning functions for threaded diffusion benchmarks
+*/
+
+/** \cond SuppressGuard */
+#ifndef _AFFINITY_H_
+#define _AFFINITY_H_
+/** \endcond */
+
+/**
+ \brief Ways of laying threads out over the sockets and cores of a node
+*/
+enum pin_layout {
+	PIN_NONE    = 0, /**< leave placement to the operating system */
+	PIN_COMPACT = 1, /**< fill each socket, core by core, before the next */
+	PIN_SCATTER = 2  /**< deal threads round-robin across sockets, cores before hyperthreads */
+};
+
+/**
+ \brief Read the requested layout and the CPU topology
+
+ The layout is taken from the environment variable \c HIPERC_PIN, which may
+ be \c none (the default), \c compact, or \c scatter. Only CPUs in the
+ process's affinity mask are used, so \c taskset and batch-scheduler limits
+ are respected. Socket and core numbers come from
+ \c /sys/devices/system/cpu/cpu*\c /topology. Call once, before pin_thread().
+*/
+void affinity_init();
+
+/**
+ \brief Pin the calling thread to the CPU for worker number \a thread
+
+ Threads beyond the number of available CPUs wrap around. Does nothing when
+ the layout is #PIN_NONE. Pin threads before allocating arrays, so that pages
+ are first touched from the CPUs that will use them.
+*/
+void pin_thread(const int thread);
+
+/**
+ \brief Describe the thread layout, for the run log
+*/
+const char* thread_placement();
+
+/** \cond SuppressGuard */
+#endif /* _AFFINITY_H_ */
+/** \endcond */
@@ -32,6 +32,44 @@ void apply_initial_conditions(fp_t** conc_old, const int nx, const int ny, const
 */
 void apply_boundary_conditions(fp_t** conc_old, const int nx, const int ny, const int nm);
 
+/**
+ \brief Worksharing body of apply_boundary_conditions(), for every thread of an enclosing parallel region
+
+ Ends with a barrier, so the ghost cells are ready to read on return. OpenMP
+ builds only.
+*/
+void apply_boundary_conditions_team(fp_t** conc_old, const int nx, const int ny, const int nm);
+
+/**
+ \brief Apply boundary conditions to row \a j of \a conc, just after it is computed
+
+ Sets the fixed values and the no-flux ghost columns of row \a j, and copies
+ the first and last interior rows into the ghost rows. Called by the thread
+ that wrote the row, inside the update sweep, this leaves the new field ready
+ for the next step, with no separate apply_boundary_conditions() pass. Unlike
+ that pass, the half-wall cells are reset before the field is written out.
+*/
+void apply_boundary_row(fp_t** conc, const int j, const int nx, const int ny, const int nm);
+
+/**
+ \brief Apply boundary conditions to rows [\a jlo, \a jhi) of \a conc, by apply_boundary_row()
+
+ Leaves the rest of the field alone, so each thread can set the boundaries of
+ its own slab without waiting for the others.
+*/
+void apply_boundary_slab(fp_t** conc, const int jlo, const int jhi, const int nx, const int ny, const int nm);
+
+/**
+ \brief Apply boundary conditions to the tile of interior rows [\a jlo, \a jhi)
+ and columns [\a ilo, \a ihi) of \a conc, just after it is computed
+
+ Sets the fixed values that fall inside the tile, then, if the tile touches an
+ edge of the interior, the ghost cells beyond that edge, corners included. The
+ tiles of a field, taken together, leave it just as apply_boundary_row() does.
+*/
+void apply_boundary_tile(fp_t** conc, const int ilo, const int ihi, const int jlo, const int jhi,
+                         const int nx, const int ny, const int nm);
+
 /** \cond SuppressGuard */
 #endif /* _BOUNDARIES_H_ */
 /** \endcond */
@@ -0,0 +1,245 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  implicit.c
+ \brief Implementation of the implicit (theta-method) time step for threaded diffusion benchmarks
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "implicit.h"
+#include "mesh.h"
+#include "numerics.h"
+#ifdef _OPENMP
+#include "multigrid.h"
+#endif
+
+/**
+ \brief Give up on a step that has not converged after this many iterations
+*/
+#define CG_MAX_ITERS 1000
+
+/* steps that gave up at CG_MAX_ITERS */
+static int cg_capped = 0;
+
+static fp_t** cg_r = NULL;
+
+static fp_t** cg_p = NULL;
+
+static fp_t** cg_q = NULL;
+
+static fp_t** cg_dinv = NULL;
+
+static fp_t* cg_rows = NULL;
+
+static fp_t cg_a = 0.;
+
+static fp_t cg_explicit = 0.;
+
+static fp_t cg_tolerance = 1.0e-8;
+
+/**
+ \brief Iterative method for each step, from \c HIPERC_SOLVER
+*/
+enum implicit_solver {
+	SOLVER_CG,      /**< conjugate gradients, Jacobi-preconditioned */
+	SOLVER_MG,      /**< multigrid cycles */
+	SOLVER_MGCG     /**< conjugate gradients, multigrid-preconditioned */
+};
+
+static enum implicit_solver cg_solver = SOLVER_CG;
+
+fp_t implicit_theta()
+{
+	const char* env = getenv("HIPERC_SCHEME");
+
+	return (env != NULL && strcmp(env, "cn") == 0) ? 0.5 : 1.0;
+}
+
+/**
+ \brief Interior index nearest to \a i, which is where a no-flux ghost cell gets its value
+*/
+static int fold(const int i, const int n, const int nm)
+{
+	return (i < nm/2) ? nm/2 : (i > n-1-nm/2) ? n-1-nm/2 : i;
+}
+
+/**
+ \brief Whether interior cell (\a i, \a j) is one apply_boundary_conditions() holds at 1
+*/
+static int is_fixed(const int i, const int j, const int nx, const int ny, const int nm)
+{
+	return (j < ny/2) ? (i == nm/2) : (i == nx-1-nm/2);
+}
+
+/**
+ \brief Copy edge cells of \a field into its ghost cells, without fixed values
+*/
+static void mirror_ghosts(fp_t** field, const int nx, const int ny, const int nm)
+{
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		for (int offset = 0; offset < nm/2; offset++) {
+			field[j][offset] = field[j][nm/2];             /* left condition */
+			field[j][nx-1-offset] = field[j][nx-1-nm/2];   /* right condition */
+		}
+	}
+
+	for (int offset = 0; offset < nm/2; offset++) {
+		memcpy(field[offset], field[nm/2], nx * sizeof(fp_t));          /* bottom condition */
+		memcpy(field[ny-1-offset], field[ny-1-nm/2], nx * sizeof(fp_t)); /* top condition */
+	}
+}
+
+/**
+ \brief Sum the per-row partial sums in order, so the result does not depend on the thread count
+*/
+static fp_t sum_rows(const int ny, const int nm)
+{
+	fp_t sum = 0.;
+
+	for (int j = nm/2; j < ny-nm/2; j++)
+		sum += cg_rows[j];
+
+	return sum;
+}
+
+void implicit_init(fp_t** const mask_lap, const int code, const fp_t dx, const fp_t dy,
+                   const int nx, const int ny, const int nm,
+                   const fp_t D, const fp_t dt, const fp_t theta)
+{
+	const char* solver = getenv("HIPERC_SOLVER");
+
+	if (nm != 3) {
+		printf("Error: the implicit solver needs a 3x3 mask, not %dx%d.\n", nm, nm);
+		exit(-1);
+	}
+
+	if (getenv("HIPERC_CG_TOLERANCE") != NULL)
+		cg_tolerance = atof(getenv("HIPERC_CG_TOLERANCE"));
+	cg_capped = 0;
+
+	cg_a = theta * dt * D;
+	cg_explicit = dt * D;
+
+	cg_r = make_field(nx, ny, nm);
+	cg_p = make_field(nx, ny, nm);
+	cg_q = make_field(nx, ny, nm);
+	cg_dinv = make_field(nx, ny, nm);
+	cg_rows = (fp_t*)calloc(ny, sizeof(fp_t));
+
+	/* the diagonal picks up the mask weights whose ghost cells fold back onto
+	   the cell itself; fixed cells get zero, which keeps them out of the solve */
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		for (int i = nm/2; i < nx-nm/2; i++) {
+			fp_t diag = 1.;
+
+			if (is_fixed(i, j, nx, ny, nm))
+				continue;
+
+			for (int mj = -nm/2; mj < nm/2+1; mj++)
+				for (int mi = -nm/2; mi < nm/2+1; mi++)
+					if (fold(i+mi, nx, nm) == i && fold(j+mj, ny, nm) == j)
+						diag -= cg_a * mask_lap[mj+nm/2][mi+nm/2];
+
+			cg_dinv[j][i] = 1. / diag;
+		}
+	}
+
+	if (solver != NULL && strcmp(solver, "mg") == 0)
+		cg_solver = SOLVER_MG;
+	else if (solver != NULL && strcmp(solver, "mgcg") == 0)
+		cg_solver = SOLVER_MGCG;
+
+	#ifdef _OPENMP
+	if (cg_solver != SOLVER_CG)
+		mg_init(cg_dinv, code, dx, dy, nx, ny, nm, cg_a);
+	#else
+	if (cg_solver != SOLVER_CG) {
+		printf("Error: HIPERC_SOLVER=%s needs the OpenMP build.\n", solver);
+		exit(-1);
+	}
+	#endif
+}
+
+/**
+ \brief Jacobi-preconditioned conjugate gradients, from the state cg_start() leaves
+*/
+static int cg_solve(fp_t** x, fp_t** const mask_lap, const int nx, const int ny, const int nm,
+                    fp_t rz, const fp_t target)
+{
+	int iters = 0;
+
+	cg_direction(cg_p, cg_r, cg_dinv, nx, ny, nm, 0.);
+
+	while (rz > target && iters < CG_MAX_ITERS) {
+		mirror_ghosts(cg_p, nx, ny, nm);
+
+		cg_apply(cg_p, cg_q, mask_lap, cg_rows, nx, ny, nm, cg_a);
+		const fp_t alpha = rz / sum_rows(ny, nm);
+
+		cg_update(x, cg_r, cg_p, cg_q, cg_dinv, cg_rows, nx, ny, nm, alpha);
+		const fp_t rz_new = sum_rows(ny, nm);
+
+		iters++;
+		if (rz_new <= target)
+			break;
+
+		cg_direction(cg_p, cg_r, cg_dinv, nx, ny, nm, rz_new / rz);
+		rz = rz_new;
+	}
+
+	return iters;
+}
+
+int implicit_step(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** const mask_lap,
+                  const int nx, const int ny, const int nm)
+{
+	int iters = 0;
+
+	/* Starting from c^n, the fixed values cancel out of the residual, leaving
+	   the explicit increment dt D L c^n on the free cells. */
+	cg_start(conc_old, conc_lap, conc_new, cg_r, cg_dinv, cg_rows, nx, ny, nm, cg_explicit);
+	const fp_t rz = sum_rows(ny, nm);
+	const fp_t target = cg_tolerance * cg_tolerance * rz;
+
+	#ifdef _OPENMP
+	if (cg_solver != SOLVER_CG)
+		iters = mg_solve(conc_new, cg_r, cg_p, cg_q, rz, target, CG_MAX_ITERS, cg_solver == SOLVER_MGCG);
+	else
+	#endif
+	iters = cg_solve(conc_new, mask_lap, nx, ny, nm, rz, target);
+
+	/* warn once as it happens; implicit_free() gives the total */
+	if (iters >= CG_MAX_ITERS && cg_capped++ == 0)
+		printf("\nWarning: an implicit step used all %d iterations allowed, and may miss HIPERC_CG_TOLERANCE.\n",
+		       CG_MAX_ITERS);
+
+	/* the solve left the fixed cells at zero */
+	for (int j = nm/2; j < ny/2; j++)
+		conc_new[j][nm/2] = 1.;
+	for (int j = ny/2; j < ny-nm/2; j++)
+		conc_new[j][nx-1-nm/2] = 1.;
+
+	return iters;
+}
+
+void implicit_free()
+{
+	if (cg_capped > 0)
+		printf("Warning: %d implicit steps used all %d iterations allowed.\n", cg_capped, CG_MAX_ITERS);
+
+	#ifdef _OPENMP
+	if (cg_solver != SOLVER_CG)
+		mg_free();
+	#endif
+
+	free_field(cg_r);
+	free_field(cg_p);
+	free_field(cg_q);
+	free_field(cg_dinv);
+	free(cg_rows);
+}
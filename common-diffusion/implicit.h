@@ -0,0 +1,60 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  implicit.h
+ \brief Declaration of the implicit (theta-method) time step for threaded diffusion benchmarks
+*/
+
+/** \cond SuppressGuard */
+#ifndef _IMPLICIT_H_
+#define _IMPLICIT_H_
+/** \endcond */
+
+#include "type.h"
+
+/**
+ \brief Weight of the new time level: 1 for backward Euler, 0.5 for Crank-Nicolson
+
+ Read from \c HIPERC_SCHEME, either \c euler (the default) or \c cn.
+*/
+fp_t implicit_theta();
+
+/**
+ \brief Allocate the solver's work fields and Jacobi preconditioner
+
+ Each step solves (1 - \a theta \a dt \a D L) c<sup>n+1</sup> = (1 + (1 - \a theta)
+ \a dt \a D L) c<sup>n</sup> for the cells not held at a fixed value, where L
+ is the mask with its no-flux ghost cells folded back onto the edge. That
+ operator is symmetric only if the ghost layer is one cell deep, so \a nm must
+ be 3. \c HIPERC_SOLVER picks the iteration: \c cg (the default), \c mg for
+ multigrid cycles, or \c mgcg for conjugate gradients preconditioned by them.
+ Multigrid builds the \a code stencil at coarser spacings than \a dx and
+ \a dy, and needs OpenMP.
+*/
+void implicit_init(fp_t** const mask_lap, const int code, const fp_t dx, const fp_t dy,
+                   const int nx, const int ny, const int nm,
+                   const fp_t D, const fp_t dt, const fp_t theta);
+
+/**
+ \brief Advance \a conc_old by one implicit step into \a conc_new, returning the number of iterations
+
+ \a conc_old must have its boundary conditions applied, and \a conc_lap must
+ hold its convolution with the mask. The iterations start
+ from \a conc_old and stop when the Jacobi-weighted residual falls by
+ \c HIPERC_CG_TOLERANCE (default 1e-8), or after 1000 iterations, with a
+ warning the first time. Ghost cells of \a conc_new are not set.
+*/
+int implicit_step(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** const mask_lap,
+                  const int nx, const int ny, const int nm);
+
+/**
+ \brief Release the solver's work fields, and report how many steps hit the iteration limit
+*/
+void implicit_free();
+
+/** \cond SuppressGuard */
+#endif /* _IMPLICIT_H_ */
+/** \endcond */
@@ -15,12 +15,106 @@
 
 #include "type.h"
 
+/**
+ \brief Alignment, in bytes, of the first element of every mesh row
+*/
+#ifndef MESH_ALIGN
+#define MESH_ALIGN 64
+#endif
+
+/**
+ \brief Rows whose length in bytes is a multiple of this get extra padding
+*/
+#ifndef MESH_CONFLICT
+#define MESH_CONFLICT 1024
+#endif
+
+/**
+ \brief Padding, in bytes, appended to rows prone to cache-set conflicts
+*/
+#ifndef MESH_PAD
+#define MESH_PAD 64
+#endif
+
+/**
+ \brief Alignment, in bytes, of arrays backed by huge pages
+*/
+#ifndef MESH_HUGE_PAGE
+#define MESH_HUGE_PAGE (2 * 1024 * 1024)
+#endif
+
+/**
+ \brief Distance, in elements, between the starts of successive mesh rows
+
+ Rows are rounded up to a multiple of #MESH_ALIGN bytes, so that every row
+ starts on a cache-line boundary. Power-of-two widths such as 512 or 2048
+ would then map the rows of a stencil onto the same cache sets, so rows whose
+ length is a multiple of #MESH_CONFLICT bytes get another #MESH_PAD bytes.
+
+ Backends that copy whole arrays as dense \f$ nx\times ny\f$ blocks, such as
+ the GPU codes, must be built with \c DENSE_MESH defined, which makes the
+ pitch equal to \a nx.
+*/
+int mesh_pitch(const int nx);
+
+/**
+ \brief Zero-fill every row of a freshly allocated array
+
+ On NUMA machines, each page lands on the memory node of the thread that
+ first writes it, so this should write the interior rows \a nm/2 through
+ \a ny-nm/2-1 with the same threads, and the same decomposition, that the
+ stencil kernels will use.
+*/
+typedef void (*touch_t)(fp_t** field, const int nx, const int ny, const int nm);
+
+/**
+ \brief Replace the function make_field() uses to zero-fill new arrays
+
+ The default splits the interior rows over OpenMP threads with a static
+ schedule, matching \c omp \c for loops over rows, unless the environment
+ variable \c HIPERC_TOUCH is \c serial. Without OpenMP, rows are filled
+ serially. Backends using other threading models may supply their own;
+ passing \c NULL restores the default.
+*/
+void set_first_touch(touch_t touch);
+
+/**
+ \brief Whether new arrays are backed by 2 MB transparent huge pages
+
+ Enabled by setting the environment variable \c HIPERC_HUGEPAGES to any value
+ but \c 0. Arrays are then aligned to #MESH_HUGE_PAGE and advised with
+ \c madvise(MADV_HUGEPAGE), which takes effect when the kernel's transparent
+ huge page setting is \c always or \c madvise.
+*/
+int mesh_huge_pages();
+
+/**
+ \brief Describe how arrays are placed in memory, for the run log
+*/
+const char* mesh_placement();
+
+/**
+ \brief Allocate one zero-filled 2D array of \a ny rows of \a nx values
+
+ Data are stored in one block aligned to #MESH_ALIGN bytes, with rows
+ mesh_pitch() elements apart, and a table of \a ny row pointers is mapped over
+ the top. Within a row, or across rows using the pitch, \c field[0] may be
+ treated as a flat array. Pages are first touched as described for
+ set_first_touch().
+*/
+fp_t** make_field(const int nx, const int ny, const int nm);
+
+/**
+ \brief Free an array allocated by make_field()
+*/
+void free_field(fp_t** field);
+
 /**
  \brief Allocate 2D arrays to store scalar composition values
 
- Arrays are allocated as 1D arrays, then 2D pointer arrays are mapped over the
- top. This facilitates use of either 1D or 2D data access, depending on whether
- the task is spatially dependent or not.
+ Arrays are allocated by make_field(), as 1D arrays with 2D pointer arrays
+ mapped over the top. This facilitates use of either 1D or 2D data access,
+ depending on whether the task is spatially dependent or not.
 */
 void make_arrays(fp_t*** conc_old, fp_t*** conc_new, fp_t*** conc_lap, fp_t*** mask_lap,
                  const int nx, const int ny, const int nm);
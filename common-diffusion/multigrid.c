@@ -0,0 +1,544 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  multigrid.c
+ \brief Implementation of geometric multigrid for the implicit diffusion operator, with OpenMP threading
+*/
+
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh.h"
+#include "multigrid.h"
+#include "numerics.h"
+#include "simd.h"
+
+/**
+ \brief Most levels in the hierarchy, enough for a 2<sup>17</sup> cell side
+*/
+#define MG_MAX_LEVELS 16
+
+/**
+ \brief Smoothing sweeps before and after each coarse-grid correction
+*/
+#define MG_SWEEPS 2
+
+/**
+ \brief Smoothing sweeps on the coarsest level, half in each direction
+*/
+#define MG_COARSE_SWEEPS 16
+
+/**
+ \brief Fields and stencil of one level, each with a single layer of ghost cells
+*/
+struct mg_level {
+	int nx;                /**< cells per row, including ghosts */
+	int ny;                /**< rows, including ghosts */
+	fp_t mask_data[9];     /**< stencil at this level's spacing */
+	fp_t* mask_lap[3];     /**< rows of \a mask_data */
+	fp_t lmax;             /**< upper bound on the eigenvalues of the Jacobi-scaled operator */
+	fp_t** u;              /**< correction */
+	fp_t** f;              /**< right-hand side */
+	fp_t** r;              /**< residual */
+	fp_t** d;              /**< Chebyshev update, if that is the smoother */
+	fp_t** dinv;           /**< inverse diagonal, zero at fixed cells */
+	fp_t* wx;              /**< restriction weights from the finer level, four per column */
+	fp_t* wy;              /**< restriction weights from the finer level, four per row */
+};
+
+static struct mg_level levels[MG_MAX_LEVELS];
+
+static int nlevels = 0;
+
+static fp_t mg_a = 0.;
+
+static int mg_gamma = 1;
+
+static int mg_full = 0;
+
+static int mg_chebyshev = 0;
+
+static int mg_colors = 2;
+
+static fp_t** mg_z = NULL;
+
+static fp_t* mg_rows = NULL;
+
+/**
+ \brief Nearest index to \a i in [0, \a n), which is where a no-flux ghost cell gets its value
+*/
+static int clamp(const int i, const int n)
+{
+	return (i < 0) ? 0 : (i > n-1) ? n-1 : i;
+}
+
+/**
+ \brief Weight of coarse cell \a I in the bilinear value of fine cell \a i, along one axis
+*/
+static fp_t prolong_weight(const int i, const int I, const int nc)
+{
+	const int near = i / 2;
+	const int far = clamp(near + ((i & 1) ? 1 : -1), nc);
+
+	return 0.75 * (near == I) + 0.25 * (far == I);
+}
+
+/**
+ \brief Copy edge cells into the ghost cells
+*/
+static void mirror(fp_t** field, const int nx, const int ny)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = 1; j < ny-1; j++) {
+		field[j][0] = field[j][1];
+		field[j][nx-1] = field[j][nx-2];
+	}
+
+	memcpy(field[0], field[1], nx * sizeof(fp_t));
+	memcpy(field[ny-1], field[ny-2], nx * sizeof(fp_t));
+}
+
+/**
+ \brief Zero a field, ghosts included
+*/
+static void zero(fp_t** field, const int nx, const int ny)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = 0; j < ny; j++)
+		memset(field[j], 0, nx * sizeof(fp_t));
+}
+
+/**
+ \brief Sum the per-row partial sums in order, so the result does not depend on the thread count
+*/
+static fp_t sum_rows(const int ny)
+{
+	fp_t sum = 0.;
+
+	for (int j = 1; j < ny-1; j++)
+		sum += mg_rows[j];
+
+	return sum;
+}
+
+/**
+ \brief r = f - (1 - a L) u on the free cells of level \a l, zero on the fixed ones
+*/
+static void residual(const int l)
+{
+	struct mg_level* L = &levels[l];
+
+	mirror(L->u, L->nx, L->ny);
+
+	#pragma omp parallel for schedule(static)
+	for (int j = 1; j < L->ny-1; j++) {
+		simd_convolve_row(L->u, L->r[j], L->mask_lap, j, 1, L->nx-1, 3);
+		for (int i = 1; i < L->nx-1; i++)
+			L->r[j][i] = (L->dinv[j][i] != 0.) ? L->f[j][i] - L->u[j][i] + mg_a * L->r[j][i] : 0.;
+	}
+}
+
+/**
+ \brief One Gauss-Seidel pass over the cells of one \a color
+
+ Two colors, like a checkerboard, leave every cell's neighbors in the other
+ color for the five-point stencil; the nine-point stencil needs four.
+*/
+static void smooth_color(const int l, const int color)
+{
+	struct mg_level* L = &levels[l];
+	fp_t** const m = L->mask_lap;
+
+	mirror(L->u, L->nx, L->ny);
+
+	#pragma omp parallel for schedule(static)
+	for (int j = 1; j < L->ny-1; j++) {
+		if (mg_colors == 4 && ((j-1) & 1) != (color >> 1))
+			continue;
+
+		const int ilo = 1 + ((mg_colors == 4) ? (color & 1) : ((j-1 + color) & 1));
+		fp_t* up = L->u[j-1];
+		fp_t* mid = L->u[j];
+		fp_t* dn = L->u[j+1];
+
+		for (int i = ilo; i < L->nx-1; i += 2) {
+			const fp_t lap = m[0][0] * up[i-1] + m[0][1] * up[i] + m[0][2] * up[i+1]
+			               + m[1][0] * mid[i-1] + m[1][1] * mid[i] + m[1][2] * mid[i+1]
+			               + m[2][0] * dn[i-1] + m[2][1] * dn[i] + m[2][2] * dn[i+1];
+			mid[i] += L->dinv[j][i] * (L->f[j][i] - mid[i] + mg_a * lap);
+		}
+	}
+}
+
+/**
+ \brief Chebyshev smoothing over the upper three quarters of the Jacobi-scaled spectrum
+*/
+static void smooth_chebyshev(const int l, const int steps)
+{
+	struct mg_level* L = &levels[l];
+	const fp_t hi = L->lmax;
+	const fp_t lo = 0.25 * L->lmax;
+	const fp_t theta = 0.5 * (hi + lo);
+	const fp_t delta = 0.5 * (hi - lo);
+	const fp_t sigma = theta / delta;
+	fp_t rho = 1. / sigma;
+
+	residual(l);
+
+	#pragma omp parallel for schedule(static)
+	for (int j = 1; j < L->ny-1; j++)
+		for (int i = 1; i < L->nx-1; i++)
+			L->d[j][i] = L->dinv[j][i] * L->r[j][i] / theta;
+
+	for (int k = 0; k < steps; k++) {
+		#pragma omp parallel for schedule(static)
+		for (int j = 1; j < L->ny-1; j++)
+			for (int i = 1; i < L->nx-1; i++)
+				L->u[j][i] += L->d[j][i];
+
+		if (k == steps-1)
+			break;
+
+		residual(l);
+
+		const fp_t rho_new = 1. / (2. * sigma - rho);
+
+		#pragma omp parallel for schedule(static)
+		for (int j = 1; j < L->ny-1; j++)
+			for (int i = 1; i < L->nx-1; i++)
+				L->d[j][i] = rho_new * rho * L->d[j][i] + 2. * rho_new / delta * L->dinv[j][i] * L->r[j][i];
+
+		rho = rho_new;
+	}
+}
+
+/**
+ \brief Smooth level \a l, visiting the colors backward if \a reverse is set
+*/
+static void smooth(const int l, const int sweeps, const int reverse)
+{
+	if (mg_chebyshev) {
+		smooth_chebyshev(l, sweeps);
+		return;
+	}
+
+	for (int s = 0; s < sweeps; s++)
+		for (int c = 0; c < mg_colors; c++)
+			smooth_color(l, reverse ? mg_colors-1-c : c);
+}
+
+/**
+ \brief Full-weighting restriction of \a src on level \a l into the right-hand side of level \a l + 1
+*/
+static void restrict_field(const int l, fp_t** src)
+{
+	struct mg_level* F = &levels[l];
+	struct mg_level* C = &levels[l+1];
+
+	#pragma omp parallel for schedule(static)
+	for (int J = 0; J < C->ny-2; J++) {
+		for (int I = 0; I < C->nx-2; I++) {
+			fp_t sum = 0.;
+
+			for (int b = 0; b < 4; b++) {
+				const int j = 2*J - 1 + b;
+				fp_t row = 0.;
+
+				if (C->wy[4*J + b] == 0.)
+					continue;
+
+				for (int a = 0; a < 4; a++) {
+					const int i = 2*I - 1 + a;
+					if (C->wx[4*I + a] != 0. && F->dinv[j+1][i+1] != 0.)
+						row += C->wx[4*I + a] * src[j+1][i+1];
+				}
+				sum += C->wy[4*J + b] * row;
+			}
+
+			C->f[J+1][I+1] = (C->dinv[J+1][I+1] != 0.) ? 0.25 * sum : 0.;
+		}
+	}
+}
+
+/**
+ \brief Add the bilinear interpolation of the correction on level \a l + 1 to level \a l
+*/
+static void prolong(const int l)
+{
+	struct mg_level* F = &levels[l];
+	struct mg_level* C = &levels[l+1];
+
+	mirror(C->u, C->nx, C->ny);
+
+	#pragma omp parallel for schedule(static)
+	for (int j = 0; j < F->ny-2; j++) {
+		const int J = j/2 + 1;
+		const int J1 = J + ((j & 1) ? 1 : -1);
+
+		for (int i = 0; i < F->nx-2; i++) {
+			const int I = i/2 + 1;
+			const int I1 = I + ((i & 1) ? 1 : -1);
+
+			if (F->dinv[j+1][i+1] != 0.)
+				F->u[j+1][i+1] += 0.5625 * C->u[J][I]
+				                + 0.1875 * (C->u[J][I1] + C->u[J1][I])
+				                + 0.0625 * C->u[J1][I1];
+		}
+	}
+}
+
+/**
+ \brief One V-cycle (or W-cycle) on level \a l, starting from its current correction
+*/
+static void cycle(const int l)
+{
+	if (l == nlevels-1) {
+		smooth(l, MG_COARSE_SWEEPS/2, 0);
+		smooth(l, MG_COARSE_SWEEPS/2, 1);
+		return;
+	}
+
+	smooth(l, MG_SWEEPS, 0);
+	residual(l);
+	restrict_field(l, levels[l].r);
+
+	zero(levels[l+1].u, levels[l+1].nx, levels[l+1].ny);
+	for (int g = 0; g < mg_gamma; g++)
+		cycle(l+1);
+
+	prolong(l);
+	smooth(l, MG_SWEEPS, 1);
+}
+
+/**
+ \brief Full multigrid: solve on the coarsest level, then interpolate and cycle on each finer one
+*/
+static void full_cycle()
+{
+	for (int l = 0; l < nlevels-1; l++)
+		restrict_field(l, levels[l].f);
+
+	zero(levels[nlevels-1].u, levels[nlevels-1].nx, levels[nlevels-1].ny);
+	cycle(nlevels-1);
+
+	for (int l = nlevels-2; l >= 0; l--) {
+		zero(levels[l].u, levels[l].nx, levels[l].ny);
+		prolong(l);
+		cycle(l);
+	}
+}
+
+/**
+ \brief Inverse diagonal of level \a l, counting mask weights whose ghost cells fold back onto the cell
+*/
+static void set_diagonal(const int l, const int fixed, const int i, const int j)
+{
+	struct mg_level* L = &levels[l];
+	fp_t diag = 1.;
+
+	if (fixed) {
+		L->dinv[j+1][i+1] = 0.;
+		return;
+	}
+
+	for (int mj = -1; mj < 2; mj++)
+		for (int mi = -1; mi < 2; mi++)
+			if (clamp(i+mi, L->nx-2) == i && clamp(j+mj, L->ny-2) == j)
+				diag -= mg_a * L->mask_lap[mj+1][mi+1];
+
+	L->dinv[j+1][i+1] = 1. / diag;
+}
+
+void mg_init(fp_t** dinv, const int code, const fp_t dx, const fp_t dy,
+             const int nx, const int ny, const int nm, const fp_t a)
+{
+	const char* env;
+
+	if (nm != 3) {
+		printf("Error: multigrid needs a 3x3 mask, not %dx%d.\n", nm, nm);
+		exit(-1);
+	}
+
+	env = getenv("HIPERC_MG_CYCLE");
+	mg_gamma = (env != NULL && strcmp(env, "w") == 0) ? 2 : 1;
+	mg_full = (env != NULL && strcmp(env, "fmg") == 0);
+
+	env = getenv("HIPERC_MG_SMOOTHER");
+	mg_chebyshev = (env != NULL && strcmp(env, "chebyshev") == 0);
+
+	mg_a = a;
+	mg_z = make_field(nx, ny, nm);
+	mg_rows = (fp_t*)calloc(ny, sizeof(fp_t));
+
+	for (int l = 0; l < MG_MAX_LEVELS; l++) {
+		struct mg_level* L = &levels[l];
+		struct mg_level* F = (l > 0) ? &levels[l-1] : NULL;
+
+		if (l > 0) {
+			/* coarsen until a side is small or the identity dominates the operator */
+			if (F->nx-2 <= 4 || F->ny-2 <= 4 || -mg_a * F->mask_lap[1][1] < 0.25)
+				break;
+			L->nx = (F->nx-2 + 1) / 2 + 2;
+			L->ny = (F->ny-2 + 1) / 2 + 2;
+		} else {
+			L->nx = nx;
+			L->ny = ny;
+		}
+
+		memset(L->mask_data, 0, sizeof(L->mask_data));
+		for (int j = 0; j < 3; j++)
+			L->mask_lap[j] = &L->mask_data[3 * j];
+		set_mask(dx * (1 << l), dy * (1 << l), code, L->mask_lap, 3);
+
+		/* Gershgorin bound for the Jacobi-scaled operator, reached away from the edges */
+		fp_t off = 0.;
+		for (int k = 0; k < 9; k++)
+			if (k != 4)
+				off += fabs(L->mask_data[k]);
+		L->lmax = 1. + mg_a * off / (1. - mg_a * L->mask_data[4]);
+
+		/* the finest level borrows u and f from each call, and dinv from the caller */
+		L->u = (l > 0) ? make_field(L->nx, L->ny, 3) : NULL;
+		L->f = (l > 0) ? make_field(L->nx, L->ny, 3) : NULL;
+		L->r = make_field(L->nx, L->ny, 3);
+		L->d = mg_chebyshev ? make_field(L->nx, L->ny, 3) : NULL;
+		L->dinv = (l > 0) ? make_field(L->nx, L->ny, 3) : dinv;
+		L->wx = NULL;
+		L->wy = NULL;
+		nlevels = l + 1;
+
+		if (l == 0)
+			continue;
+
+		/* restriction weights are the bilinear prolongation weights, transposed */
+		const int nfx = F->nx-2, nfy = F->ny-2;
+		const int ncx = L->nx-2, ncy = L->ny-2;
+
+		L->wx = (fp_t*)calloc(4 * ncx, sizeof(fp_t));
+		L->wy = (fp_t*)calloc(4 * ncy, sizeof(fp_t));
+		for (int I = 0; I < ncx; I++)
+			for (int o = 0; o < 4; o++)
+				if (2*I - 1 + o >= 0 && 2*I - 1 + o < nfx)
+					L->wx[4*I + o] = prolong_weight(2*I - 1 + o, I, ncx);
+		for (int J = 0; J < ncy; J++)
+			for (int o = 0; o < 4; o++)
+				if (2*J - 1 + o >= 0 && 2*J - 1 + o < nfy)
+					L->wy[4*J + o] = prolong_weight(2*J - 1 + o, J, ncy);
+
+		/* a coarse cell is fixed if any of its fine cells is */
+		for (int J = 0; J < ncy; J++) {
+			for (int I = 0; I < ncx; I++) {
+				int fixed = 0;
+				for (int b = 0; b < 2; b++)
+					for (int c = 0; c < 2; c++)
+						fixed |= (F->dinv[clamp(2*J + b, nfy) + 1][clamp(2*I + c, nfx) + 1] == 0.);
+				set_diagonal(l, fixed, I, J);
+			}
+		}
+	}
+
+	mg_colors = (levels[0].mask_lap[0][0] != 0.) ? 4 : 2;
+}
+
+fp_t mg_cycle(fp_t** r, fp_t** z, const int full)
+{
+	struct mg_level* L = &levels[0];
+
+	L->f = r;
+	L->u = z;
+	zero(z, L->nx, L->ny);
+
+	if (full)
+		full_cycle();
+	else
+		cycle(0);
+
+	#pragma omp parallel for schedule(static)
+	for (int j = 1; j < L->ny-1; j++) {
+		fp_t sum = 0.;
+		for (int i = 1; i < L->nx-1; i++)
+			if (L->dinv[j][i] != 0.)
+				sum += r[j][i] * z[j][i];
+		mg_rows[j] = sum;
+	}
+
+	return sum_rows(L->ny);
+}
+
+int mg_solve(fp_t** x, fp_t** r, fp_t** p, fp_t** q, fp_t rd, const fp_t target,
+             const int max_iters, const int krylov)
+{
+	struct mg_level* L = &levels[0];
+	const int nx = L->nx, ny = L->ny;
+	int iters = 0;
+
+	if (!krylov) {
+		/* each cycle solves for the error, which corrects x and r */
+		while (rd > target && iters < max_iters) {
+			mg_cycle(r, p, mg_full && iters == 0);
+			mirror(p, nx, ny);
+			cg_apply(p, q, L->mask_lap, mg_rows, nx, ny, 3, mg_a);
+			cg_update(x, r, p, q, L->dinv, mg_rows, nx, ny, 3, 1.);
+			rd = sum_rows(ny);
+			iters++;
+		}
+		return iters;
+	}
+
+	fp_t rz = mg_cycle(r, mg_z, 0);
+
+	#pragma omp parallel for schedule(static)
+	for (int j = 1; j < ny-1; j++)
+		memcpy(p[j], mg_z[j], nx * sizeof(fp_t));
+
+	while (rd > target && iters < max_iters) {
+		mirror(p, nx, ny);
+
+		cg_apply(p, q, L->mask_lap, mg_rows, nx, ny, 3, mg_a);
+		const fp_t alpha = rz / sum_rows(ny);
+
+		cg_update(x, r, p, q, L->dinv, mg_rows, nx, ny, 3, alpha);
+		rd = sum_rows(ny);
+
+		iters++;
+		if (rd <= target)
+			break;
+
+		const fp_t rz_new = mg_cycle(r, mg_z, 0);
+		const fp_t beta = rz_new / rz;
+
+		#pragma omp parallel for schedule(static)
+		for (int j = 1; j < ny-1; j++)
+			for (int i = 1; i < nx-1; i++)
+				p[j][i] = mg_z[j][i] + beta * p[j][i];
+
+		rz = rz_new;
+	}
+
+	return iters;
+}
+
+void mg_free()
+{
+	for (int l = 0; l < nlevels; l++) {
+		struct mg_level* L = &levels[l];
+		if (l > 0) {
+			free_field(L->u);
+			free_field(L->f);
+			free_field(L->dinv);
+			free(L->wx);
+			free(L->wy);
+		}
+		free_field(L->r);
+		if (L->d != NULL)
+			free_field(L->d);
+	}
+	free_field(mg_z);
+	free(mg_rows);
+	nlevels = 0;
+}
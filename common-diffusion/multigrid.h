@@ -0,0 +1,61 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  multigrid.h
+ \brief Declaration of geometric multigrid for the implicit diffusion operator, with OpenMP threading
+*/
+
+/** \cond SuppressGuard */
+#ifndef _MULTIGRID_H_
+#define _MULTIGRID_H_
+/** \endcond */
+
+#include "type.h"
+
+/**
+ \brief Build the grid hierarchy for (1 - \a a L), where L is the mask from set_mask()
+
+ The mesh is cell-centered, so each coarse cell covers two by two fine cells,
+ and each level uses the \a code stencil at its own spacing. No-flux ghost cells
+ fold back onto the edge at every level, as in implicit_init(). Cells where the
+ fine-grid \a dinv is zero hold fixed values: the correction there is zero, and
+ a coarse cell is fixed if any of its fine cells is. Coarsening stops when a
+ side falls to four cells or the identity dominates the operator. The cycle is
+ chosen by \c HIPERC_MG_CYCLE (\c v, \c w, or \c fmg) and the smoother by
+ \c HIPERC_MG_SMOOTHER (\c gs or \c chebyshev). \a nm must be 3.
+*/
+void mg_init(fp_t** dinv, const int code, const fp_t dx, const fp_t dy,
+             const int nx, const int ny, const int nm, const fp_t a);
+
+/**
+ \brief Approximately solve (1 - \a a L) \a z = \a r with one cycle from zero, returning r * z
+
+ Red-black Gauss-Seidel visits the colors in reverse after the coarse-grid
+ correction, and restriction is the transpose of bilinear prolongation, so a
+ V- or W-cycle is a symmetric preconditioner. \a full starts with a full
+ multigrid pass, which is not.
+*/
+fp_t mg_cycle(fp_t** r, fp_t** z, const int full);
+
+/**
+ \brief Drive the residual \a r of \a x down to \a target, in the Jacobi-weighted norm \a rd
+
+ Starts from the state cg_start() leaves, and uses \a p and \a q as work
+ fields. With \a krylov set, runs conjugate gradients preconditioned by one
+ cycle per iteration; otherwise, each iteration corrects \a x by one cycle.
+ Returns the number of iterations.
+*/
+int mg_solve(fp_t** x, fp_t** r, fp_t** p, fp_t** q, fp_t rd, const fp_t target,
+             const int max_iters, const int krylov);
+
+/**
+ \brief Release the coarse grids
+*/
+void mg_free();
+
+/** \cond SuppressGuard */
+#endif /* _MULTIGRID_H_ */
+/** \endcond */
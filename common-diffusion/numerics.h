@@ -40,6 +40,10 @@
 
  If your stencil is larger than \f$ 5\times 5\f$, you must increase the values
  defined by #MAX_MASK_W and #MAX_MASK_H.
+
+ This also selects the row kernel used by convolve_row(). For best performance,
+ write a kernel specialized for your mask and add it to the table searched by
+ select_stencil(); otherwise, convolve_row_generic() is used.
 */
 void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, const int nm);
 
@@ -69,6 +73,39 @@ void nine_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap,
 */
 void slow_nine_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap, const int nm);
 
+/**
+ \brief Convolve the mask with rows \a j-nm/2 through \a j+nm/2 of \a conc,
+ writing columns \a ilo through \a ihi-1 of \a conc_row
+
+ Kernels of this type are specialized for the footprint of a given mask: the
+ zero entries are skipped entirely, and the non-zero coefficients are read
+ once per row rather than once per point.
+*/
+typedef void (*stencil_row_t)(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                              const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Look up the row kernel specialized for the mask \a code
+
+ Codes with no specialized kernel, or a mask size \a nm that does not match
+ the code, get convolve_row_generic().
+*/
+stencil_row_t select_stencil(const int code, const int nm);
+
+/**
+ \brief Convolve one row using the kernel selected by the last call to set_mask()
+
+ This is the row-wise building block for compute_convolution().
+*/
+void convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                  const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Convolve one row with an arbitrary \f$ nm\times nm\f$ mask
+*/
+void convolve_row_generic(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                          const int j, const int ilo, const int ihi, const int nm);
+
 /**
    \brief Perform the convolution of the mask matrix with the composition matrix
 
@@ -88,6 +125,120 @@ void update_composition(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
 				   const int nx, const int ny, const int nm,
 				   const fp_t D, const fp_t dt);
 
+/**
+   \brief Update one stage of a Runge-Kutta-Legendre super-step
+
+   Sets \a stage = \a mu \a stage_1 + \a nu \a stage_2 + (1 - \a mu - \a nu)
+   \a conc_old + \a mu_dt \a conc_lap + \a gamma_dt \a lap_old, where
+   \a stage_1 and \a stage_2 are the two previous stages, \a conc_lap is the
+   convolution of \a stage_1, and \a lap_old that of \a conc_old. See rkl_step().
+*/
+void update_stage(fp_t** conc_old, fp_t** lap_old, fp_t** stage_1, fp_t** stage_2,
+                  fp_t** conc_lap, fp_t** stage, const int nx, const int ny, const int nm,
+                  const fp_t mu, const fp_t nu, const fp_t mu_dt, const fp_t gamma_dt);
+
+/**
+   \brief Worksharing body of compute_convolution(), for every thread of an enclosing parallel region
+
+   Rows are shared out with a static schedule and there is no barrier at the
+   end: update_composition_team(), with the same schedule, only reads rows of
+   \a conc_lap that the same thread wrote. OpenMP builds only.
+*/
+void compute_convolution_team(fp_t** const conc_old, fp_t** conc_lap, fp_t** const mask_lap,
+                              const int nx, const int ny, const int nm);
+
+/**
+   \brief Worksharing body of update_composition(), for every thread of an enclosing parallel region
+
+   Ends without a barrier; the caller must add one before \a conc_new is read
+   across rows. OpenMP builds only.
+*/
+void update_composition_team(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
+                             const int nx, const int ny, const int nm,
+                             const fp_t D, const fp_t dt);
+
+/**
+   \brief Convolve rows [\a jlo, \a jhi) only, for a thread that owns that slab
+
+   The caller must first make sure the neighboring slabs' boundary values are
+   set, e.g. with slab_wait(). OpenMP builds only, as are the other \c _slab
+   functions.
+*/
+void compute_convolution_slab(fp_t** const conc_old, fp_t** conc_lap, fp_t** const mask_lap,
+                              const int jlo, const int jhi, const int nx, const int nm);
+
+/**
+   \brief Update rows [\a jlo, \a jhi) only, from rows the same thread convolved
+*/
+void update_composition_slab(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
+                             const int jlo, const int jhi,
+                             const int nx, const int ny, const int nm,
+                             const fp_t D, const fp_t dt);
+
+/**
+   \brief Create one task per tile to advance the field by one step, without waiting for them
+
+   The interior is cut into tiles of \a bx by \a by cells, each at least \a nm/2
+   wide. The task for a tile convolves and updates it, then applies
+   apply_boundary_tile() to its part of \a conc_new. It depends on the tiles
+   around it from the previous step, through the sentinels in \a tile_deps
+   (max(\a depth, 2) per tile, taken in turn by \a step), so tasks from
+   several steps run at once. Before creating any, waits for the tasks of the
+   step \a depth back; a \a depth of 0 never waits. Call from one thread of a
+   parallel region, and \c taskwait before reading \a conc_new. OpenMP builds
+   only.
+*/
+void compute_step_tasks(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** const mask_lap,
+                        char* tile_deps, const int step, const int depth,
+                        const int bx, const int by, const int nx, const int ny, const int nm,
+                        const fp_t D, const fp_t dt);
+
+/**
+   \brief Advance the field by \a steps steps in one recursive space-time traversal
+
+   Cuts the space-time volume into trapezoids (Frigo and Strumpen), so each
+   patch of the mesh advances many steps while it is in cache. Boundary
+   conditions are evaluated on the fly, so the result matches the stepwise
+   apply_boundary_conditions(), compute_convolution(), update_composition()
+   loop exactly on the interior; ghost cells are left untouched. Trapezoids
+   narrower than \a bx by \a by are not cut further. The final step ends up in
+   \a conc_old if \a steps is even, \a conc_new if odd. Serial builds only.
+*/
+void compute_trapezoid(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** const mask_lap,
+                       const int bx, const int by, const int nx, const int ny, const int nm,
+                       const fp_t D, const fp_t dt, const int steps);
+
+/**
+   \brief Start a conjugate gradient solve from \a conc_old, which must have its boundary conditions applied
+
+   Copies the free cells of \a conc_old into \a x, with the fixed cells (where
+   \a dinv is zero) zeroed, and sets the residual \a r to \a a times
+   \a conc_lap there. Row \a j of \a rows receives that row's sum of r * dinv * r.
+   OpenMP and TBB builds only, as are the other \c cg_ functions.
+*/
+void cg_start(fp_t** conc_old, fp_t** conc_lap, fp_t** x, fp_t** r, fp_t** dinv, fp_t* rows,
+              const int nx, const int ny, const int nm, const fp_t a);
+
+/**
+   \brief Apply the implicit operator, \a q = \a p - \a a (mask * \a p), and sum p * q by row into \a rows
+
+   The ghost cells of \a p must already mirror its edges.
+*/
+void cg_apply(fp_t** p, fp_t** q, fp_t** const mask_lap, fp_t* rows,
+              const int nx, const int ny, const int nm, const fp_t a);
+
+/**
+   \brief Step \a x along \a p and \a r along \a q by \a alpha, summing the new r * dinv * r by row into \a rows
+*/
+void cg_update(fp_t** x, fp_t** r, fp_t** p, fp_t** q, fp_t** dinv, fp_t* rows,
+               const int nx, const int ny, const int nm, const fp_t alpha);
+
+/**
+   \brief Set the next search direction, \a p = \a dinv * \a r + \a beta * \a p
+*/
+void cg_direction(fp_t** p, fp_t** r, fp_t** dinv,
+                  const int nx, const int ny, const int nm, const fp_t beta);
+
 /**
  \brief Compute Euclidean distance between two points, \a a and \a b
 */
@@ -123,16 +274,60 @@ fp_t distance_point_to_segment(const fp_t ax, const fp_t ay,
 */
 void analytical_value(const fp_t x, const fp_t t, const fp_t D, fp_t* c);
 
+/**
+ \brief Sampling stride for check_solution(), from the environment
+
+ Set \c HIPERC_RSS_STRIDE to \e s to compare every <em>s</em>th row and column
+ only, about \f$ 1/s^2 \f$ of the mesh. The default, 1, checks every point.
+*/
+int rss_stride();
+
+/**
+   \brief Residual sum of squares along row \a j, normalized to the domain size
+
+   Covers every <em>stride</em>th point of the row, starting at the first
+   interior point, and stores the sum of the squared terms in \a sumsq (if not
+   NULL) for sampled_rss(). The distance to each source is worked out per row
+   in closed form, and \f$ \mathrm{erfc} \f$ is a branch-free series, so the
+   loop vectorizes.
+*/
+fp_t residual_row(fp_t** conc_new, const int j, const int nx, const int ny,
+                  const fp_t dx, const fp_t dy, const int nm,
+                  const fp_t elapsed, const fp_t D, const int stride, fp_t* sumsq);
+
+/**
+   \brief Combine per-row results of residual_row() into the RSS and its error
+
+   \a sums and \a squares are indexed by row; every <em>stride</em>th row from
+   the first interior row is read, in order. With \a stride 1 the RSS is exact
+   and \a rss_err is zero. Otherwise the sample is scaled up to the mesh and
+   \a rss_err is its standard error.
+*/
+void sampled_rss(const fp_t* sums, const fp_t* squares, const int nx, const int ny,
+                 const int nm, const int stride, fp_t* rss, fp_t* rss_err);
+
+/**
+   \brief Worksharing body of check_solution(), for every thread of an enclosing parallel region
+
+   Every thread must call it with the same \a sums, scratch for 2 \a ny values.
+   Ends with a barrier, after which \a rss and \a rss_err are set.
+*/
+void check_solution_team(fp_t** conc_new, const int nx, const int ny,
+                         const fp_t dx, const fp_t dy, const int nm,
+                         const fp_t elapsed, const fp_t D, fp_t* sums, fp_t* rss, fp_t* rss_err);
+
 /**
    \brief Compare numerical and analytical solutions of the diffusion equation
-   \return Residual sum of squares (RSS), normalized to the domain size.
+   \return Residual sum of squares (RSS), normalized to the domain size, and
+   its standard error when rss_stride() asks for sampling.
 
-   Overwrites \a conc_lap, into which the point-wise RSS is written.
-   Normalized RSS is then computed as the sum of the point-wise values.
+   Rows are reduced in parallel, when OpenMP is available, and their sums added
+   in order, so the result is the same for any number of threads. No scratch
+   field is written.
 */
-void check_solution(fp_t** conc_new, fp_t** conc_lap, const int nx, const int ny,
+void check_solution(fp_t** conc_new, const int nx, const int ny,
                     const fp_t dx, const fp_t dy, const int nm,
-                    const fp_t elapsed, const fp_t D, fp_t* rss);
+                    const fp_t elapsed, const fp_t D, fp_t* rss, fp_t* rss_err);
 
 /** \cond SuppressGuard */
 #endif /* _NUMERICS_H_ */
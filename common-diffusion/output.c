@@ -12,7 +12,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iso646.h>
+#include <math.h>
+#include <limits.h>
+#include <ctype.h>
 #include <png.h>
+#include <zlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "output.h"
 
 void param_parser(int argc, char* argv[], int* bx, int* by, int* checks, int* code,
@@ -145,12 +153,72 @@ void print_progress(const int step, const int steps)
 	}
 }
 
+/**
+ \brief Output lines per block of CSV formatted by one thread
+*/
+#define CSV_BLOCK_LINES 16384
+
+/**
+ \brief Room to leave in a CSV buffer for one more line, however long
+*/
+#define CSV_LINE_MAX 1024
+
+/**
+ \brief Format \a value as \c printf("%f") would, returning the number of characters written
+
+ Values below \f$ 10^{15} \f$ in magnitude are split into exact integer and
+ fractional parts. The fraction is scaled to six digits, and the sign of the
+ exact remainder, found with fma(), rounds it half-to-even like the C library,
+ so output matches \c printf byte for byte. Anything larger, infinite, or NaN
+ falls back on sprintf().
+*/
+static int format_fixed(char* out, const double value)
+{
+	const double mag = fabs(value);
+	char digits[20];
+	char* p = out;
+	int k = 0;
+
+	if (!(mag < 1.0e15))
+		return sprintf(out, "%f", value);
+
+	const double whole = floor(mag);
+	const double frac = mag - whole;
+	const double scaled = floor(frac * 1.0e6);
+	const double above = fma(frac, 1.0e6, -(scaled + 0.5));
+	uint64_t ip = (uint64_t)whole;
+	uint64_t fp = (uint64_t)scaled;
+
+	if (above > 0.0 || (above == 0.0 && (fp & 1)))
+		fp++;
+	if (fp == 1000000) {
+		fp = 0;
+		ip++;
+	}
+
+	if (signbit(value))
+		*p++ = '-';
+	do {
+		digits[k++] = '0' + ip % 10;
+		ip /= 10;
+	} while (ip > 0);
+	while (k > 0)
+		*p++ = digits[--k];
+	*p++ = '.';
+	for (k = 5; k >= 0; k--) {
+		p[k] = '0' + fp % 10;
+		fp /= 10;
+	}
+
+	return (int)(p + 6 - out);
+}
+
 void write_csv(fp_t** conc, const int nx, const int ny, const fp_t dx, const fp_t dy, const int step)
 {
 	FILE* output;
 	char name[256];
 	char num[20];
-	int i, j;
+	int b;
 
 	/* generate the filename */
 	sprintf(num, "%07i", step);
@@ -165,33 +233,219 @@ void write_csv(fp_t** conc, const int nx, const int ny, const fp_t dx, const fp_
 		exit(-1);
 	}
 
-	/* write csv data */
+	/* write csv data: threads format blocks of rows, which are written in order */
 	fprintf(output, "x,y,c\n");
-	for (j = 1; j < ny-1; j++) {
-		fp_t y = dy * (j - 1);
-		for (i = 1; i < nx-1; i++)	{
-			fp_t x = dx * (i - 1);
-			fprintf(output, "%f,%f,%f\n", x, y, conc[j][i]);
+
+	const int rows = (nx - 2 < CSV_BLOCK_LINES) ? CSV_BLOCK_LINES / (nx - 2) : 1;
+	const int nblocks = (ny - 2 + rows - 1) / rows;
+
+	#ifdef _OPENMP
+	#pragma omp parallel
+	#endif
+	{
+		size_t capacity = (size_t)rows * (nx - 2) * 40 + CSV_LINE_MAX;
+		char* buffer = (char*)malloc(capacity);
+
+		#ifdef _OPENMP
+		#pragma omp for schedule(static, 1) ordered
+		#endif
+		for (b = 0; b < nblocks; b++) {
+			const int jlo = 1 + rows * b;
+			const int jhi = (jlo + rows < ny - 1) ? jlo + rows : ny - 1;
+			size_t n = 0;
+
+			for (int j = jlo; j < jhi; j++) {
+				fp_t y = dy * (j - 1);
+				for (int i = 1; i < nx-1; i++)	{
+					fp_t x = dx * (i - 1);
+					if (capacity - n < CSV_LINE_MAX) {
+						capacity *= 2;
+						buffer = (char*)realloc(buffer, capacity);
+					}
+					n += format_fixed(&buffer[n], x);
+					buffer[n++] = ',';
+					n += format_fixed(&buffer[n], y);
+					buffer[n++] = ',';
+					n += format_fixed(&buffer[n], conc[j][i]);
+					buffer[n++] = '\n';
+				}
+			}
+
+			#ifdef _OPENMP
+			#pragma omp ordered
+			#endif
+			fwrite(buffer, sizeof(char), n, output);
 		}
+
+		free(buffer);
 	}
 
 	fclose(output);
 }
 
+/**
+ \brief Minimum filtered bytes per independently compressed strip of a PNG
+
+ Each strip restarts the deflate dictionary, which costs a few bytes of
+ compression, so strips are kept large enough for that to be negligible.
+*/
+#define PNG_STRIP_BYTES 262144
+
+/**
+ \brief Stand-in filter type for choosing the best filter row by row
+*/
+#define PNG_FILTER_ADAPTIVE -1
+
+/**
+ \brief Read PNG compression level and row filter from the environment
+
+ \c HIPERC_PNG_LEVEL is a zlib level from 0 (store) to 9 (smallest);
+ \c HIPERC_PNG_FILTER is \c none, \c sub, \c up, \c avg, \c paeth, or
+ \c adaptive. The defaults match libpng.
+*/
+static void png_options(int* level, int* filter)
+{
+	const char* env_level = getenv("HIPERC_PNG_LEVEL");
+	const char* env_filter = getenv("HIPERC_PNG_FILTER");
+
+	*level = Z_DEFAULT_COMPRESSION;
+	*filter = PNG_FILTER_ADAPTIVE;
+
+	if (env_level != NULL) {
+		const int value = atoi(env_level);
+		if (value >= 0 && value <= 9 && isdigit((unsigned char)env_level[0]))
+			*level = value;
+		else
+			printf("Warning: HIPERC_PNG_LEVEL %s is not in 0-9. Using the default.\n", env_level);
+	}
+
+	if (env_filter == NULL || strcmp(env_filter, "adaptive") == 0)
+		*filter = PNG_FILTER_ADAPTIVE;
+	else if (strcmp(env_filter, "none") == 0)
+		*filter = PNG_FILTER_VALUE_NONE;
+	else if (strcmp(env_filter, "sub") == 0)
+		*filter = PNG_FILTER_VALUE_SUB;
+	else if (strcmp(env_filter, "up") == 0)
+		*filter = PNG_FILTER_VALUE_UP;
+	else if (strcmp(env_filter, "avg") == 0)
+		*filter = PNG_FILTER_VALUE_AVG;
+	else if (strcmp(env_filter, "paeth") == 0)
+		*filter = PNG_FILTER_VALUE_PAETH;
+	else
+		printf("Warning: unknown HIPERC_PNG_FILTER %s. Using adaptive filtering.\n", env_filter);
+}
+
+/**
+ \brief Apply one PNG filter to an 8-bit grayscale row, writing \a w + 1 bytes to \a line
+*/
+static void filter_row(const unsigned char* row, const unsigned char* prev, const int w,
+                       const int type, unsigned char* line)
+{
+	int i;
+
+	line[0] = (unsigned char)type;
+	line++;
+
+	switch (type) {
+		case PNG_FILTER_VALUE_SUB:
+			line[0] = row[0];
+			for (i = 1; i < w; i++)
+				line[i] = row[i] - row[i-1];
+			break;
+		case PNG_FILTER_VALUE_UP:
+			for (i = 0; i < w; i++)
+				line[i] = row[i] - prev[i];
+			break;
+		case PNG_FILTER_VALUE_AVG:
+			line[0] = row[0] - (prev[0] >> 1);
+			for (i = 1; i < w; i++)
+				line[i] = row[i] - ((row[i-1] + prev[i]) >> 1);
+			break;
+		case PNG_FILTER_VALUE_PAETH:
+			line[0] = row[0] - prev[0];
+			for (i = 1; i < w; i++) {
+				const int a = row[i-1], b = prev[i], c = prev[i-1];
+				const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+				const int p = (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+				line[i] = row[i] - p;
+			}
+			break;
+		default:
+			memcpy(line, row, w);
+	}
+}
+
+/**
+ \brief libpng's heuristic for comparing filters: sum of bytes taken as signed magnitudes
+*/
+static unsigned long filter_cost(const unsigned char* line, const int w)
+{
+	unsigned long sum = 0;
+
+	for (int i = 1; i < w + 1; i++)
+		sum += (line[i] < 128) ? line[i] : 256 - line[i];
+
+	return sum;
+}
+
+/**
+ \brief Filter every row of an image into PNG scanlines, one filter byte per row
+*/
+static void filter_image(const unsigned char* image, unsigned char* scanlines,
+                         const int w, const int h, const int filter)
+{
+	unsigned char* zero = (unsigned char*)calloc(w, sizeof(unsigned char));
+
+	#ifdef _OPENMP
+	#pragma omp parallel
+	#endif
+	{
+		unsigned char* trial = (unsigned char*)malloc(w + 1);
+		int j;
+
+		#ifdef _OPENMP
+		#pragma omp for schedule(static)
+		#endif
+		for (j = 0; j < h; j++) {
+			const unsigned char* row = &image[w * j];
+			const unsigned char* prev = (j > 0) ? &image[w * (j-1)] : zero;
+			unsigned char* line = &scanlines[(size_t)(w + 1) * j];
+
+			if (filter != PNG_FILTER_ADAPTIVE) {
+				filter_row(row, prev, w, filter, line);
+			} else {
+				unsigned long best = ULONG_MAX;
+				for (int type = PNG_FILTER_VALUE_NONE; type < PNG_FILTER_VALUE_LAST; type++) {
+					filter_row(row, prev, w, type, trial);
+					const unsigned long cost = filter_cost(trial, w);
+					if (cost < best) {
+						best = cost;
+						memcpy(line, trial, w + 1);
+					}
+				}
+			}
+		}
+
+		free(trial);
+	}
+
+	free(zero);
+}
+
 void write_png(fp_t** conc, const int nx, const int ny, const int step)
 {
 	/* After "A simple libpng example program," http://zarb.org/~gc/html/libpng.html
 	   and the libpng manual, http://www.libpng.org/pub/png */
 
-	fp_t min, max, *c;
-	int i, j, w, h, n;
+	fp_t min, max;
+	int i, j, s, w, h, level, filter;
 	FILE* output;
 	char name[256];
 	char num[20];
 	unsigned char* buffer;
+	unsigned char* scanlines;
 
 	png_infop info_ptr;
-	png_bytepp row_pointers;
 	png_structp png_ptr;
 	png_byte color_type = PNG_COLOR_TYPE_GRAY;
 	png_byte bit_depth = 8;
@@ -199,6 +453,8 @@ void write_png(fp_t** conc, const int nx, const int ny, const int step)
 	w = nx - 2;
 	h = ny - 2;
 
+	png_options(&level, &filter);
+
 	/* generate the filename */
 	sprintf(num, "%07i", step);
 	strcpy(name, "diffusion.");
@@ -212,39 +468,97 @@ void write_png(fp_t** conc, const int nx, const int ny, const int step)
 		exit(-1);
 	}
 
-	/* allocate and populate image array */
-	buffer = (unsigned char*)malloc(w * h * sizeof(unsigned char));
-	row_pointers = (png_bytepp)malloc(h * sizeof(png_bytep));
-	for (j = 0; j < h; j++)
-		row_pointers[j] = &buffer[w * j];
+	/* allocate image and scanline arrays */
+	buffer = (unsigned char*)malloc((size_t)w * h * sizeof(unsigned char));
+	scanlines = (unsigned char*)malloc((size_t)(w + 1) * h * sizeof(unsigned char));
 
 	/* determine data range */
 	min = 0.0;
 	max = 1.0;
-	for (j = ny-2; j > 0; j--) {
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i) reduction(min:min) reduction(max:max)
+	#endif
+	for (j = 1; j < ny-1; j++) {
+		#ifdef _OPENMP
+		#pragma omp simd reduction(min:min) reduction(max:max)
+		#endif
 		for (i = 1; i < nx-1; i++) {
-			c = &conc[j][i];
-			if (*c < min)
-				min = *c;
-			if (*c > max)
-				max = *c;
+			const fp_t c = conc[j][i];
+			min = (c < min) ? c : min;
+			max = (c > max) ? c : max;
 		}
 	}
 
-	/* rescale data into buffer */
-	n = 0;
+	/* rescale data into buffer, top row first */
+	#ifdef _OPENMP
+	#pragma omp parallel for private(i)
+	#endif
 	for (j = ny-2; j > 0; j--) {
-		for (i = 1; i < nx-1; i++) {
-			buffer[n] = (unsigned char) 255 * (min + (conc[j][i] - min) / (max - min));
-			n++;
+		unsigned char* row = &buffer[(size_t)w * (ny-2 - j)];
+		for (i = 1; i < nx-1; i++)
+			row[i-1] = (unsigned char) 255 * (min + (conc[j][i] - min) / (max - min));
+	}
+
+	filter_image(buffer, scanlines, w, h, filter);
+
+	/* deflate strips of rows independently and in parallel. Every strip but the
+	   last ends in a sync flush, which pads to a byte boundary without marking the
+	   final block, so the strips concatenate into one valid zlib stream. */
+	const size_t pitch = (size_t)w + 1;
+	const int per_strip = (pitch * h > PNG_STRIP_BYTES) ? (int)((PNG_STRIP_BYTES + pitch - 1) / pitch) : h;
+	const int nstrips = (h + per_strip - 1) / per_strip;
+	unsigned char** zdata = (unsigned char**)malloc(nstrips * sizeof(unsigned char*));
+	size_t* zsize = (size_t*)malloc(nstrips * sizeof(size_t));
+	uLong* zsum = (uLong*)malloc(nstrips * sizeof(uLong));
+
+	#ifdef _OPENMP
+	#pragma omp parallel for schedule(dynamic, 1)
+	#endif
+	for (s = 0; s < nstrips; s++) {
+		const int rows = (s < nstrips - 1) ? per_strip : h - per_strip * s;
+		unsigned char* src = &scanlines[pitch * per_strip * s];
+		const size_t length = pitch * rows;
+		z_stream strm;
+		int status;
+
+		memset(&strm, 0, sizeof(z_stream));
+		if (deflateInit2(&strm, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			printf("Error making image: unable to initialize zlib.\n");
+			exit(-1);
 		}
+
+		const size_t bound = deflateBound(&strm, length) + 16;
+		zdata[s] = (unsigned char*)malloc(bound);
+		strm.next_in = src;
+		strm.avail_in = length;
+		strm.next_out = zdata[s];
+		strm.avail_out = bound;
+
+		status = deflate(&strm, (s < nstrips - 1) ? Z_SYNC_FLUSH : Z_FINISH);
+		if (strm.avail_in != 0 || status == Z_STREAM_ERROR) {
+			printf("Error making image: unable to compress rows.\n");
+			exit(-1);
+		}
+		zsize[s] = bound - strm.avail_out;
+		zsum[s] = adler32(adler32(0L, Z_NULL, 0), src, length);
+		deflateEnd(&strm);
 	}
-	if (n != w * h) {
-		printf("Error making image: expected %i values in buffer, got %i.\n", w*h, n);
-		exit(-1);
+
+	/* zlib header and trailer wrap the raw deflate strips */
+	const int flevel = (level == 0 || level == 1) ? 0 : (level >= 2 && level <= 5) ? 1 : (level == 6 || level < 0) ? 2 : 3;
+	unsigned int header = (0x78 << 8) | (flevel << 6);
+	header += 31 - header % 31;
+	const unsigned char zhead[2] = {(unsigned char)(header >> 8), (unsigned char)(header & 0xff)};
+
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (s = 0; s < nstrips; s++) {
+		const int rows = (s < nstrips - 1) ? per_strip : h - per_strip * s;
+		adler = adler32_combine(adler, zsum[s], pitch * rows);
 	}
+	const unsigned char ztail[4] = {(unsigned char)(adler >> 24), (unsigned char)(adler >> 16),
+	                                (unsigned char)(adler >> 8),  (unsigned char)(adler)};
 
-	/* let libpng do the heavy lifting */
+	/* let libpng write the container around the compressed data */
 	png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (!png_ptr) {
 		printf("Error making image: png_create_write_struct failed.\n");
@@ -268,21 +582,417 @@ void write_png(fp_t** conc, const int nx, const int ny, const int step)
 
 	png_write_info(png_ptr, info_ptr);
 
-	/* write image */
+	/* write image, one IDAT chunk per strip */
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		printf("Error making image: unable to write data.\n");
 		exit(-1);
 	}
-	png_write_image(png_ptr, row_pointers);
+	for (s = 0; s < nstrips; s++) {
+		const size_t extra = ((s == 0) ? sizeof(zhead) : 0) + ((s == nstrips - 1) ? sizeof(ztail) : 0);
+		png_write_chunk_start(png_ptr, (png_const_bytep)"IDAT", zsize[s] + extra);
+		if (s == 0)
+			png_write_chunk_data(png_ptr, zhead, sizeof(zhead));
+		png_write_chunk_data(png_ptr, zdata[s], zsize[s]);
+		if (s == nstrips - 1)
+			png_write_chunk_data(png_ptr, ztail, sizeof(ztail));
+		png_write_chunk_end(png_ptr);
+	}
 
 	if (setjmp(png_jmpbuf(png_ptr))) {
 		printf("Error making image: unable to finish writing.\n");
 		exit(-1);
 	}
-	png_write_end(png_ptr, NULL);
+	png_write_chunk(png_ptr, (png_const_bytep)"IEND", NULL, 0);
 
 	/* clean up */
+	png_destroy_write_struct(&png_ptr, &info_ptr);
 	fclose(output);
-	free(row_pointers);
+	for (s = 0; s < nstrips; s++)
+		free(zdata[s]);
+	free(zdata);
+	free(zsize);
+	free(zsum);
+	free(scanlines);
 	free(buffer);
 }
+
+/**
+ \brief Largest quantized value, in steps of twice the tolerance, before a value is stored verbatim
+*/
+#define CODEC_RANGE 1125899906842624.0 /* 2^50 */
+
+/**
+ \brief Worst-case bytes per value in an uncompressed tile of quantization codes
+*/
+#define CODEC_BYTES 10
+
+/**
+ \brief Append \a value to \a codes as a little-endian base-128 varint
+*/
+static size_t put_varint(unsigned char* codes, uint64_t value)
+{
+	size_t n = 0;
+
+	while (value >= 0x80) {
+		codes[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	codes[n++] = (unsigned char)value;
+
+	return n;
+}
+
+/**
+ \brief Read a varint written by put_varint() from \a codes, which ends just before \a end
+
+ Returns the number of bytes read, or 0 if the varint runs past \a end or is
+ longer than the 10 bytes a 64-bit value can need.
+*/
+static size_t get_varint(const unsigned char* codes, const unsigned char* end, uint64_t* value)
+{
+	size_t n = 0;
+	int shift = 0;
+
+	*value = 0;
+	do {
+		if (codes + n >= end || shift > 63)
+			return 0;
+		*value |= (uint64_t)(codes[n] & 0x7f) << shift;
+		shift += 7;
+	} while (codes[n++] & 0x80);
+
+	return n;
+}
+
+/**
+ \brief Quantize and compress one tile of a field, returning the compressed size
+
+ Each value is rounded to the nearest multiple of twice the tolerance, and the
+ integer multiples are predicted from their west, north, and north-west
+ neighbors in the tile (the Lorenzo predictor). Prediction is exact in
+ integers, so the decoder reproduces it exactly. Smooth fields leave residuals
+ of a few units, which are coded as zig-zag varints and deflated. A value that
+ cannot meet the bound after rounding, or is too large to quantize, is stored
+ verbatim behind a zero code and predicts as zero.
+*/
+static size_t encode_tile(fp_t** conc, const int i0, const int i1, const int j0, const int j1,
+                          const double tolerance, int64_t* k, unsigned char* codes, unsigned char** zdata)
+{
+	const double quantum = 2.0 * tolerance;
+	const int w = i1 - i0;
+	size_t n = 0;
+
+	for (int j = j0; j < j1; j++) {
+		for (int i = i0; i < i1; i++) {
+			const int l = w * (j - j0) + (i - i0);
+			const fp_t value = conc[j][i];
+			const double q = value / quantum;
+			int exact = (fabs(q) < CODEC_RANGE);
+
+			k[l] = 0;
+			if (exact) {
+				k[l] = llround(q);
+				exact = (fabs(value - (fp_t)(k[l] * quantum)) <= tolerance);
+			}
+
+			if (exact) {
+				const int64_t west = (i > i0) ? k[l-1] : 0;
+				const int64_t north = (j > j0) ? k[l-w] : 0;
+				const int64_t northwest = (i > i0 && j > j0) ? k[l-w-1] : 0;
+				const int64_t residual = k[l] - (west + north - northwest);
+				const uint64_t zigzag = (residual < 0) ? 2 * (uint64_t)(-residual) - 1 : 2 * (uint64_t)residual;
+				n += put_varint(&codes[n], zigzag + 1);
+			} else {
+				k[l] = 0;
+				codes[n++] = 0;
+				memcpy(&codes[n], &value, sizeof(fp_t));
+				n += sizeof(fp_t);
+			}
+		}
+	}
+
+	uLongf size = compressBound(n);
+	*zdata = (unsigned char*)malloc(size);
+	if (compress2(*zdata, &size, codes, n, Z_DEFAULT_COMPRESSION) != Z_OK) {
+		printf("Error: unable to compress checkpoint tile.\n");
+		exit(-1);
+	}
+
+	return size;
+}
+
+/**
+ \brief Decompress and reconstruct one tile written by encode_tile()
+*/
+static int decode_tile(fp_t** conc, const int i0, const int i1, const int j0, const int j1,
+                       const double tolerance, const unsigned char* zdata, const size_t zsize,
+                       int64_t* k, unsigned char* codes)
+{
+	const double quantum = 2.0 * tolerance;
+	const int w = i1 - i0;
+	uLongf length = (uLongf)CODEC_BYTES * w * (j1 - j0);
+	size_t n = 0;
+
+	if (uncompress(codes, &length, zdata, zsize) != Z_OK)
+		return 0;
+
+	for (int j = j0; j < j1; j++) {
+		for (int i = i0; i < i1; i++) {
+			const int l = w * (j - j0) + (i - i0);
+			uint64_t symbol;
+			const size_t m = get_varint(&codes[n], codes + length, &symbol);
+
+			if (m == 0)
+				return 0;
+			n += m;
+
+			if (symbol == 0) {
+				if (n + sizeof(fp_t) > length)
+					return 0;
+				memcpy(&conc[j][i], &codes[n], sizeof(fp_t));
+				n += sizeof(fp_t);
+				k[l] = 0;
+			} else {
+				const uint64_t zigzag = symbol - 1;
+				const int64_t residual = (zigzag & 1) ? -(int64_t)((zigzag + 1) / 2) : (int64_t)(zigzag / 2);
+				const int64_t west = (i > i0) ? k[l-1] : 0;
+				const int64_t north = (j > j0) ? k[l-w] : 0;
+				const int64_t northwest = (i > i0 && j > j0) ? k[l-w-1] : 0;
+				k[l] = residual + (west + north - northwest);
+				conc[j][i] = (fp_t)(k[l] * quantum);
+			}
+		}
+	}
+
+	return (n == length);
+}
+
+/**
+ \brief Write \a conc to \a output as independently compressed tiles, in parallel
+*/
+static int write_tiles(FILE* output, fp_t** conc, const int nx, const int ny, const double tolerance)
+{
+	const int tx = (nx + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+	const int ty = (ny + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+	struct CheckpointTiles tiles;
+	int t;
+
+	memset(&tiles, 0, sizeof(tiles));
+	tiles.tolerance = tolerance;
+	tiles.tile = CHECKPOINT_TILE;
+	tiles.ntiles = tx * ty;
+
+	unsigned char** zdata = (unsigned char**)malloc(tiles.ntiles * sizeof(unsigned char*));
+	uint64_t* zsize = (uint64_t*)malloc(tiles.ntiles * sizeof(uint64_t));
+
+	#ifdef _OPENMP
+	#pragma omp parallel
+	#endif
+	{
+		int64_t* k = (int64_t*)malloc(CHECKPOINT_TILE * CHECKPOINT_TILE * sizeof(int64_t));
+		unsigned char* codes = (unsigned char*)malloc(CODEC_BYTES * CHECKPOINT_TILE * CHECKPOINT_TILE);
+
+		#ifdef _OPENMP
+		#pragma omp for schedule(dynamic)
+		#endif
+		for (t = 0; t < tiles.ntiles; t++) {
+			const int i0 = CHECKPOINT_TILE * (t % tx), j0 = CHECKPOINT_TILE * (t / tx);
+			const int i1 = (i0 + CHECKPOINT_TILE < nx) ? i0 + CHECKPOINT_TILE : nx;
+			const int j1 = (j0 + CHECKPOINT_TILE < ny) ? j0 + CHECKPOINT_TILE : ny;
+			zsize[t] = encode_tile(conc, i0, i1, j0, j1, tolerance, k, codes, &zdata[t]);
+		}
+
+		free(codes);
+		free(k);
+	}
+
+	int ok = (fwrite(&tiles, sizeof(tiles), 1, output) == 1)
+	      && (fwrite(zsize, sizeof(uint64_t), tiles.ntiles, output) == (size_t)tiles.ntiles);
+	for (t = 0; t < tiles.ntiles; t++) {
+		ok = ok && (fwrite(zdata[t], 1, zsize[t], output) == zsize[t]);
+		free(zdata[t]);
+	}
+
+	free(zsize);
+	free(zdata);
+
+	return ok;
+}
+
+/**
+ \brief Reconstruct \a conc from the tiles following a checkpoint header, in parallel
+*/
+static int read_tiles(const char* data, const size_t length, fp_t** conc, const int nx, const int ny)
+{
+	const int tx = (nx + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+	const int ty = (ny + CHECKPOINT_TILE - 1) / CHECKPOINT_TILE;
+	struct CheckpointTiles tiles;
+	int t, ok = 1;
+
+	if (length < sizeof(tiles))
+		return 0;
+	memcpy(&tiles, data, sizeof(tiles));
+	if (tiles.tile != CHECKPOINT_TILE || tiles.ntiles != tx * ty || !(tiles.tolerance > 0.0)
+	    || length < sizeof(tiles) + tiles.ntiles * sizeof(uint64_t))
+		return 0;
+
+	const uint64_t* zsize = (const uint64_t*)(data + sizeof(tiles));
+	size_t* offset = (size_t*)malloc((tiles.ntiles + 1) * sizeof(size_t));
+	offset[0] = sizeof(tiles) + tiles.ntiles * sizeof(uint64_t);
+	/* tile by tile, so corrupt sizes cannot wrap around to the right total */
+	for (t = 0; t < tiles.ntiles && ok; t++) {
+		ok = (zsize[t] <= length - offset[t]);
+		offset[t+1] = offset[t] + zsize[t];
+	}
+	if (!ok || offset[tiles.ntiles] != length) {
+		free(offset);
+		return 0;
+	}
+
+	#ifdef _OPENMP
+	#pragma omp parallel reduction(&&:ok)
+	#endif
+	{
+		int64_t* k = (int64_t*)malloc(CHECKPOINT_TILE * CHECKPOINT_TILE * sizeof(int64_t));
+		unsigned char* codes = (unsigned char*)malloc(CODEC_BYTES * CHECKPOINT_TILE * CHECKPOINT_TILE);
+
+		#ifdef _OPENMP
+		#pragma omp for schedule(dynamic)
+		#endif
+		for (t = 0; t < tiles.ntiles; t++) {
+			const int i0 = CHECKPOINT_TILE * (t % tx), j0 = CHECKPOINT_TILE * (t / tx);
+			const int i1 = (i0 + CHECKPOINT_TILE < nx) ? i0 + CHECKPOINT_TILE : nx;
+			const int j1 = (j0 + CHECKPOINT_TILE < ny) ? j0 + CHECKPOINT_TILE : ny;
+			ok = decode_tile(conc, i0, i1, j0, j1, tiles.tolerance, (const unsigned char*)data + offset[t],
+			                 zsize[t], k, codes) && ok;
+		}
+
+		free(codes);
+		free(k);
+	}
+
+	free(offset);
+
+	return ok;
+}
+
+void write_checkpoint(fp_t** conc, const int nx, const int ny, const int nm,
+                      const fp_t dx, const fp_t dy, const int step, const fp_t elapsed)
+{
+	FILE* output;
+	char name[256];
+	char temp[264];
+	struct Checkpoint header;
+	const char* env = getenv("HIPERC_CHECKPOINT_TOLERANCE");
+	const double tolerance = (env != NULL) ? atof(env) : 0.0;
+
+	/* generate the filename */
+	sprintf(name, "diffusion.%07i.dat", step);
+	sprintf(temp, "%s.part", name);
+
+	/* open the file */
+	output = fopen(temp, "wb");
+	if (output == NULL) {
+		printf("Error: unable to open %s for output. Check permissions.\n", temp);
+		exit(-1);
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.fp_width = sizeof(fp_t);
+	header.nx = nx;
+	header.ny = ny;
+	header.nm = nm;
+	header.dx = dx;
+	header.dy = dy;
+	header.elapsed = elapsed;
+	header.step = step;
+	header.codec = (tolerance > 0.0) ? CODEC_QUANTIZED : CODEC_RAW;
+
+	/* write header, then rows without padding or compressed tiles */
+	int ok = (fwrite(&header, sizeof(header), 1, output) == 1);
+	if (header.codec == CODEC_QUANTIZED)
+		ok = ok && write_tiles(output, conc, nx, ny, tolerance);
+	for (int j = 0; ok && header.codec == CODEC_RAW && j < ny; j++)
+		ok = (fwrite(conc[j], sizeof(fp_t), nx, output) == (size_t)nx);
+
+	if (fclose(output) != 0 || !ok) {
+		printf("Error: unable to write %s. Check free space.\n", temp);
+		exit(-1);
+	}
+
+	if (rename(temp, name) != 0) {
+		printf("Error: unable to rename %s to %s.\n", temp, name);
+		exit(-1);
+	}
+}
+
+void read_checkpoint(const char* name, fp_t** conc, const int nx, const int ny, const int nm,
+                     const fp_t dx, const fp_t dy, int* step, fp_t* elapsed)
+{
+	struct stat info;
+	const size_t expected = sizeof(struct Checkpoint) + (size_t)nx * ny * sizeof(fp_t);
+
+	int input = open(name, O_RDONLY);
+	if (input < 0 || fstat(input, &info) != 0) {
+		printf("Error: unable to open checkpoint %s.\n", name);
+		exit(-1);
+	}
+	if ((size_t)info.st_size < sizeof(struct Checkpoint)) {
+		printf("Error: %s is too short to be a checkpoint.\n", name);
+		exit(-1);
+	}
+
+	void* map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, input, 0);
+	if (map == MAP_FAILED) {
+		printf("Error: unable to map checkpoint %s.\n", name);
+		exit(-1);
+	}
+	close(input);
+
+	const struct Checkpoint* header = (const struct Checkpoint*)map;
+
+	if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0
+	    || header->version != CHECKPOINT_VERSION) {
+		printf("Error: %s is not a version %i checkpoint.\n", name, CHECKPOINT_VERSION);
+		exit(-1);
+	}
+	if (header->fp_width != (int32_t)sizeof(fp_t)) {
+		printf("Error: %s holds %i-byte values, but this build uses %i-byte values.\n",
+		       name, header->fp_width, (int)sizeof(fp_t));
+		exit(-1);
+	}
+	if (header->nx != nx || header->ny != ny || header->nm != nm) {
+		printf("Error: %s holds a %i x %i mesh with mask size %i, but this run uses %i x %i with %i.\n",
+		       name, header->nx, header->ny, header->nm, nx, ny, nm);
+		exit(-1);
+	}
+	if (header->codec == CODEC_RAW && (size_t)info.st_size != expected) {
+		printf("Error: %s should be %zu bytes, but is %zu.\n", name, expected, (size_t)info.st_size);
+		exit(-1);
+	}
+	if (header->dx != dx || header->dy != dy)
+		printf("Warning: %s has resolution %f x %f, but this run uses %f x %f.\n",
+		       name, header->dx, header->dy, dx, dy);
+
+	if (header->codec == CODEC_QUANTIZED) {
+		if (!read_tiles((const char*)map + sizeof(struct Checkpoint), info.st_size - sizeof(struct Checkpoint),
+		                conc, nx, ny)) {
+			printf("Error: %s is truncated or corrupt.\n", name);
+			exit(-1);
+		}
+	} else if (header->codec == CODEC_RAW) {
+		const fp_t* data = (const fp_t*)((const char*)map + sizeof(struct Checkpoint));
+		for (int j = 0; j < ny; j++)
+			memcpy(conc[j], &data[(size_t)nx * j], nx * sizeof(fp_t));
+	} else {
+		printf("Error: %s uses unknown codec %i.\n", name, header->codec);
+		exit(-1);
+	}
+
+	*step = header->step;
+	*elapsed = header->elapsed;
+
+	munmap(map, info.st_size);
+}
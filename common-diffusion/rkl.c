@@ -0,0 +1,233 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  rkl.c
+ \brief Implementation of Runge-Kutta-Legendre super-time-stepping for CPU diffusion benchmarks
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include "boundaries.h"
+#include "mesh.h"
+#include "numerics.h"
+#include "rkl.h"
+#include "timer.h"
+
+/**
+ \brief Wavenumbers sampled per &pi; by mask_spectral_radius()
+*/
+#define RKL_SAMPLES 64
+
+/**
+ \brief Default bound on the error of any Fourier mode over a checkpoint interval, for rkl_scale()
+*/
+#define RKL_TOLERANCE 1.0e-3
+
+static int rkl_s = 1;
+
+static fp_t rkl_dt = 0.;
+
+static fp_t rkl_D = 0.;
+
+static fp_t** lap_old = NULL;
+
+static fp_t** stage_a = NULL;
+
+static fp_t** stage_b = NULL;
+
+/**
+ \brief Fourier symbol of the mask at every sampled wavenumber, [-&pi;, &pi;] by [0, &pi;], into \a symbol
+*/
+static void mask_symbols(fp_t** const mask_lap, const int nm, fp_t* symbol)
+{
+	const fp_t pi = acos(-1.);
+	int n = 0;
+
+	for (int q = 0; q <= RKL_SAMPLES; q++) {
+		for (int p = -RKL_SAMPLES; p <= RKL_SAMPLES; p++) {
+			const fp_t kx = pi * p / RKL_SAMPLES;
+			const fp_t ky = pi * q / RKL_SAMPLES;
+
+			symbol[n] = 0.;
+			for (int mj = -nm/2; mj < nm/2+1; mj++)
+				for (int mi = -nm/2; mi < nm/2+1; mi++)
+					symbol[n] += mask_lap[mj+nm/2][mi+nm/2] * cos(kx * mi + ky * mj);
+			n++;
+		}
+	}
+}
+
+fp_t mask_spectral_radius(fp_t** const mask_lap, const int nm)
+{
+	const int modes = (RKL_SAMPLES + 1) * (2 * RKL_SAMPLES + 1);
+	fp_t* symbol = (fp_t*)malloc(modes * sizeof(fp_t));
+	fp_t rho = 0.;
+
+	mask_symbols(mask_lap, nm, symbol);
+	for (int n = 0; n < modes; n++)
+		if (fabs(symbol[n]) > rho)
+			rho = fabs(symbol[n]);
+
+	free(symbol);
+
+	return rho;
+}
+
+/**
+ \brief Weight b<sub>j</sub> of the second-order Legendre stages
+*/
+static fp_t rkl_b(const int j)
+{
+	return (j < 2) ? 1. / 3. : (j*j + j - 2.) / (2. * j * (j + 1.));
+}
+
+/**
+ \brief Fewest stages whose stability limit exceeds \a dt, given the forward Euler limit \a euler
+*/
+static int stages_for(const fp_t euler, const fp_t dt)
+{
+	/* at the bound itself, an even stage count leaves the checkerboard undamped */
+	int s = 2;
+	while ((s * s + s - 2.) / 4. * euler <= dt)
+		s++;
+
+	return s;
+}
+
+/**
+ \brief Factor by which an \a s stage super-step multiplies a mode whose Laplacian is \a a times the mode, per unit of \a D dt
+
+ The same recurrence as rkl_step(), on one number.
+*/
+static fp_t amplification(const int s, const fp_t a)
+{
+	const fp_t w1 = 4. / (s*s + s - 2.);
+	fp_t y_2 = 1.;
+	fp_t y_1 = 1. + rkl_b(1) * w1 * a;
+
+	for (int j = 2; j < s+1; j++) {
+		const fp_t mu = (2.*j - 1.) / j * rkl_b(j) / rkl_b(j-1);
+		const fp_t nu = -(j - 1.) / j * rkl_b(j) / rkl_b(j-2);
+		const fp_t y = mu * y_1 + nu * y_2 + (1. - mu - nu)
+		             + mu * w1 * a * y_1 - (1. - rkl_b(j-1)) * mu * w1 * a;
+		y_2 = y_1;
+		y_1 = y;
+	}
+
+	return y_1;
+}
+
+int rkl_scale(fp_t** const mask_lap, const int nm, const fp_t D, const fp_t dt, const int checks)
+{
+	const int modes = (RKL_SAMPLES + 1) * (2 * RKL_SAMPLES + 1);
+	fp_t* symbol = (fp_t*)malloc(modes * sizeof(fp_t));
+	fp_t tol = RKL_TOLERANCE;
+	fp_t rho = 0.;
+	int scale;
+
+	if (getenv("HIPERC_RKL_TOLERANCE") != NULL)
+		tol = atof(getenv("HIPERC_RKL_TOLERANCE"));
+
+	mask_symbols(mask_lap, nm, symbol);
+	for (int n = 0; n < modes; n++)
+		if (fabs(symbol[n]) > rho)
+			rho = fabs(symbol[n]);
+
+	/* the longest stride that divides checks and follows every mode closely enough */
+	for (scale = checks; scale > 1; scale--) {
+		if (checks % scale != 0)
+			continue;
+
+		const fp_t h = scale * dt;
+		const int s = stages_for(2. / (D * rho), h);
+		const int steps = checks / scale;
+		fp_t error = 0.;
+
+		for (int n = 0; n < modes && error <= tol; n++) {
+			const fp_t a = D * h * symbol[n];
+			const fp_t e = fabs(pow(amplification(s, a), steps) - exp(steps * a));
+			if (e > error)
+				error = e;
+		}
+
+		if (error <= tol)
+			break;
+	}
+
+	free(symbol);
+
+	return scale;
+}
+
+void rkl_init(fp_t** const mask_lap, const int nx, const int ny, const int nm,
+              const fp_t D, const fp_t dt)
+{
+	rkl_s = stages_for(2. / (D * mask_spectral_radius(mask_lap, nm)), dt);
+
+	rkl_dt = dt;
+	rkl_D = D;
+
+	lap_old = make_field(nx, ny, nm);
+	stage_a = make_field(nx, ny, nm);
+	stage_b = make_field(nx, ny, nm);
+}
+
+int rkl_stages()
+{
+	return rkl_s;
+}
+
+void rkl_step(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** const mask_lap,
+              const int nx, const int ny, const int nm, struct Stopwatch* watch)
+{
+	const int s = rkl_s;
+	const fp_t w1 = 4. / (s*s + s - 2.);
+	double start_time;
+
+	/* stage j lives in stage[j % 3], arranged so the last one lands in conc_new;
+	   stage 0 is conc_old, which is only read back for the second stage */
+	fp_t** stage[3];
+	stage[s % 3] = conc_new;
+	stage[(s+1) % 3] = stage_a;
+	stage[(s+2) % 3] = stage_b;
+
+	apply_boundary_conditions(conc_old, nx, ny, nm);
+
+	start_time = GetTimer();
+	compute_convolution(conc_old, lap_old, mask_lap, nx, ny, nm);
+	watch->conv += GetTimer() - start_time;
+
+	/* first stage: a forward Euler step of mu_1 dt */
+	start_time = GetTimer();
+	update_stage(conc_old, lap_old, conc_old, conc_old, lap_old, stage[1], nx, ny, nm,
+	             0., 0., rkl_b(1) * w1 * rkl_dt * rkl_D, 0.);
+	watch->step += GetTimer() - start_time;
+
+	for (int j = 2; j < s+1; j++) {
+		const fp_t mu = (2.*j - 1.) / j * rkl_b(j) / rkl_b(j-1);
+		const fp_t nu = -(j - 1.) / j * rkl_b(j) / rkl_b(j-2);
+		const fp_t mu_dt = mu * w1 * rkl_dt * rkl_D;
+		const fp_t gamma_dt = -(1. - rkl_b(j-1)) * mu_dt;
+
+		apply_boundary_conditions(stage[(j-1) % 3], nx, ny, nm);
+
+		start_time = GetTimer();
+		compute_convolution(stage[(j-1) % 3], conc_lap, mask_lap, nx, ny, nm);
+		watch->conv += GetTimer() - start_time;
+
+		start_time = GetTimer();
+		update_stage(conc_old, lap_old, stage[(j-1) % 3], (j == 2) ? conc_old : stage[(j-2) % 3],
+		             conc_lap, stage[j % 3], nx, ny, nm, mu, nu, mu_dt, gamma_dt);
+		watch->step += GetTimer() - start_time;
+	}
+}
+
+void rkl_free()
+{
+	free_field(lap_old);
+	free_field(stage_a);
+	free_field(stage_b);
+}
@@ -0,0 +1,71 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  rkl.h
+ \brief Declaration of Runge-Kutta-Legendre super-time-stepping for CPU diffusion benchmarks
+*/
+
+/** \cond SuppressGuard */
+#ifndef _RKL_H_
+#define _RKL_H_
+/** \endcond */
+
+#include "type.h"
+
+/**
+ \brief Largest magnitude of the Fourier symbol of the mask, which bounds its eigenvalues
+
+ Scans wavenumbers over [-&pi;, &pi;] by [0, &pi;], ends included, so the
+ checkerboard modes that set the bound for the Laplacian stencils are hit
+ exactly.
+*/
+fp_t mask_spectral_radius(fp_t** const mask_lap, const int nm);
+
+/**
+ \brief Number of explicit steps of \a dt for a super-step to span, by default
+
+ Picks the largest divisor of \a checks for which, over one checkpoint
+ interval, every sampled Fourier mode of the mask decays as it should to
+ within \c HIPERC_RKL_TOLERANCE (default 10<sup>-3</sup>) of its starting
+ amplitude. Stiff modes count as much as smooth ones, since too few stages
+ damp them slowly. The stage count for each candidate is picked as in rkl_init().
+*/
+int rkl_scale(fp_t** const mask_lap, const int nm, const fp_t D, const fp_t dt, const int checks);
+
+/**
+ \brief Choose the stage count for super-steps of \a dt, and allocate the stage fields
+
+ An s-stage second-order Runge-Kutta-Legendre step (Meyer, Balsara, and Aslam,
+ 2014) is stable up to (s<sup>2</sup> + s - 2) / 4 times the forward Euler
+ limit, 2 / (\a D &rho;), where &rho; is mask_spectral_radius(). The fewest
+ stages whose limit exceeds \a dt are used.
+*/
+void rkl_init(fp_t** const mask_lap, const int nx, const int ny, const int nm,
+              const fp_t D, const fp_t dt);
+
+/**
+ \brief Number of stages, each one convolution, in a super-step
+*/
+int rkl_stages();
+
+/**
+ \brief Advance \a conc_old by one super-step into \a conc_new
+
+ Boundary conditions are applied to \a conc_old and each stage before it is
+ convolved into \a conc_lap. Time spent in the convolutions and the updates
+ is added to \a watch.
+*/
+void rkl_step(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** const mask_lap,
+              const int nx, const int ny, const int nm, struct Stopwatch* watch);
+
+/**
+ \brief Release the stage fields
+*/
+void rkl_free();
+
+/** \cond SuppressGuard */
+#endif /* _RKL_H_ */
+/** \endcond */
@@ -0,0 +1,236 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  adaptive.c
+ \brief Implementation of energy-stable adaptive time stepping for spinodal decomposition
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "adaptive.h"
+#include "mesh.h"
+#include "numerics.h"
+
+/**
+ \brief Wavenumbers sampled per &pi; by explicit_dt_limit()
+*/
+#define ADAPT_SAMPLES 64
+
+/**
+ \brief Relative rise in free energy put down to roundoff in the sum
+*/
+#define ADAPT_ROUNDOFF 1.0e-12
+
+/**
+ \brief Fraction of the first step below which rejected steps give up
+*/
+#define ADAPT_FLOOR 1.0e-6
+
+static fp_t adapt_next = 0.;
+
+static fp_t adapt_last = 0.;
+
+static fp_t adapt_max = 0.;
+
+static fp_t adapt_min = 0.;
+
+static fp_t adapt_tol = 1.0e-4;
+
+static int adapt_every = 1;
+
+static fp_t adapt_lowest = HUGE_VAL;
+
+/* steps handed out since adapt_save(), and the shortest and longest of them */
+static int span_steps = 0;
+
+static fp_t span_lo = 0.;
+
+static fp_t span_hi = 0.;
+
+/* accepted and rejected steps since adapt_log(), and the range accepted */
+static int log_accepted = 0;
+
+static int log_rejected = 0;
+
+static fp_t log_lo = 0.;
+
+static fp_t log_hi = 0.;
+
+static fp_t** conc_bak = NULL;
+
+static fp_t elapsed_bak = 0.;
+
+static int bak_nx = 0;
+
+static int bak_ny = 0;
+
+fp_t explicit_dt_limit(fp_t** const mask_lap, const int nm, const fp_t M, const fp_t kappa)
+{
+	const fp_t pi = acos(-1.);
+	const fp_t S = well_curvature();
+	fp_t rate = 0.;
+
+	/* ends included, so the checkerboard modes are hit exactly */
+	for (int q = 0; q <= ADAPT_SAMPLES; q++) {
+		for (int p = -ADAPT_SAMPLES; p <= ADAPT_SAMPLES; p++) {
+			const fp_t kx = pi * p / ADAPT_SAMPLES;
+			const fp_t ky = pi * q / ADAPT_SAMPLES;
+			fp_t m = 0.;
+
+			for (int mj = -nm/2; mj < nm/2+1; mj++)
+				for (int mi = -nm/2; mi < nm/2+1; mi++)
+					m += mask_lap[mj+nm/2][mi+nm/2] * cos(kx * mi + ky * mj);
+
+			if (M * (kappa * m * m + S * fabs(m)) > rate)
+				rate = M * (kappa * m * m + S * fabs(m));
+		}
+	}
+
+	return 0.8 * 2.0 / rate;
+}
+
+void adapt_init(const fp_t dt, const fp_t dt_max, const int interval,
+                const int nx, const int ny, const int nm)
+{
+	adapt_every = interval;
+	if (getenv("HIPERC_ADAPT_TOLERANCE") != NULL)
+		adapt_tol = atof(getenv("HIPERC_ADAPT_TOLERANCE"));
+	if (getenv("HIPERC_ADAPT_INTERVAL") != NULL)
+		adapt_every = atoi(getenv("HIPERC_ADAPT_INTERVAL"));
+	if (adapt_every < 1)
+		adapt_every = 1;
+
+	adapt_max = dt_max;
+	adapt_next = adapt_last = (dt < dt_max) ? dt : dt_max;
+	adapt_min = ADAPT_FLOOR * adapt_next;
+	adapt_lowest = HUGE_VAL;
+	span_steps = log_accepted = log_rejected = 0;
+
+	conc_bak = make_field(nx, ny, nm);
+	bak_nx = nx;
+	bak_ny = ny;
+}
+
+int adapt_interval()
+{
+	return adapt_every;
+}
+
+fp_t adapt_dt(const fp_t remaining)
+{
+	if (remaining <= adapt_next)
+		adapt_last = remaining;
+	else if (remaining < 2. * adapt_next)
+		adapt_last = 0.5 * remaining;
+	else
+		adapt_last = adapt_next;
+
+	if (span_steps == 0 || adapt_last < span_lo)
+		span_lo = adapt_last;
+	if (span_steps == 0 || adapt_last > span_hi)
+		span_hi = adapt_last;
+	span_steps++;
+
+	return adapt_last;
+}
+
+static void copy_field(fp_t** from, fp_t** to)
+{
+	#ifdef _OPENMP
+	#pragma omp parallel for schedule(static)
+	#endif
+	for (int j = 0; j < bak_ny; j++)
+		memcpy(to[j], from[j], bak_nx * sizeof(fp_t));
+}
+
+void adapt_save(fp_t** conc, const fp_t elapsed)
+{
+	copy_field(conc, conc_bak);
+	elapsed_bak = elapsed;
+	span_steps = 0;
+}
+
+int adapt_accept(fp_t** conc, const fp_t energy_old, const fp_t energy_new, fp_t* elapsed)
+{
+	const fp_t drop = (energy_old - energy_new) / fabs(energy_old);
+	const fp_t span = *elapsed - elapsed_bak;
+	fp_t next = 2. * adapt_next;
+
+	/* Rises within roundoff are measured from the lowest energy yet, so they
+	   cannot add up. Written to reject NaN, too. */
+	if (energy_old < adapt_lowest)
+		adapt_lowest = energy_old;
+	if (!(energy_new < adapt_lowest + ADAPT_ROUNDOFF * fabs(adapt_lowest))) {
+		copy_field(conc_bak, conc);
+		*elapsed = elapsed_bak;
+		log_rejected += span_steps;
+		span_steps = 0;
+
+		adapt_next = 0.5 * adapt_last;
+		if (adapt_next < adapt_min) {
+			printf("Error: no step down to %e lowers the free energy.\n", adapt_last);
+			exit(-1);
+		}
+		return 0;
+	}
+
+	/* The drop per step is the drop over the span, times the step over the
+	   span; aim a little short of the step that would meet the target. */
+	if (drop * next > 0.9 * adapt_tol * span)
+		next = 0.9 * adapt_tol * span / drop;
+	if (next < 0.5 * adapt_next)
+		next = 0.5 * adapt_next;
+	adapt_next = (next < adapt_max) ? next : adapt_max;
+
+	if (log_accepted == 0 || span_lo < log_lo)
+		log_lo = span_lo;
+	if (log_accepted == 0 || span_hi > log_hi)
+		log_hi = span_hi;
+	log_accepted += span_steps;
+	span_steps = 0;
+
+	return 1;
+}
+
+void adapt_log(FILE* output)
+{
+	/* every digit of the step, so adapt_resume() can carry on exactly */
+	fprintf(output, "# dt=%.17g, from %e to %e over %d steps, %d rejected\n",
+	        adapt_next, log_lo, log_hi, log_accepted, log_rejected);
+
+	log_accepted = log_rejected = 0;
+}
+
+int adapt_resume(const char* name, const int step)
+{
+	FILE* input = fopen(name, "r");
+	char line[1024];
+	int row = -1, found = 0;
+	double dt;
+
+	if (input == NULL)
+		return 0;
+
+	/* the last comment to follow a row for this step wins */
+	while (fgets(line, sizeof(line), input) != NULL) {
+		if (line[0] != '#')
+			row = atoi(line);
+		else if (row == step && sscanf(line, "# dt=%lf", &dt) == 1) {
+			adapt_next = (dt < adapt_max) ? dt : adapt_max;
+			found = 1;
+		}
+	}
+	fclose(input);
+
+	return found;
+}
+
+void adapt_free()
+{
+	free_field(conc_bak);
+}
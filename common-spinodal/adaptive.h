@@ -0,0 +1,96 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  adaptive.h
+ \brief Declaration of energy-stable adaptive time stepping for spinodal decomposition
+*/
+
+/** \cond SuppressGuard */
+#ifndef _ADAPTIVE_H_
+#define _ADAPTIVE_H_
+/** \endcond */
+
+#include <stdio.h>
+#include "type.h"
+
+/**
+ \brief Largest forward Euler step that keeps the stencil update stable
+
+ Each Fourier mode of the linearized update changes at a rate of at most
+ \a M (\a kappa m<sup>2</sup> + S |m|), where m is the symbol of the mask and
+ S = 2&rho;(C<sub>b</sub> - C<sub>a</sub>)<sup>2</sup> is the curvature of the
+ double well at its minima. The step returned keeps that rate times the step
+ within 80% of 2, leaving room for steeper curvature outside the wells.
+*/
+fp_t explicit_dt_limit(fp_t** const mask_lap, const int nm, const fp_t M, const fp_t kappa);
+
+/**
+ \brief Start the controller at a step of \a dt, which it will never grow past \a dt_max
+
+ Each step aims to lower the free energy by \c HIPERC_ADAPT_TOLERANCE (default
+ 1e-4) of its value: fast decomposition takes short steps, and slow coarsening
+ long ones. The energy is checked every \a interval steps, unless
+ \c HIPERC_ADAPT_INTERVAL says otherwise. Allocates a copy of the field to
+ fall back on.
+*/
+void adapt_init(const fp_t dt, const fp_t dt_max, const int interval,
+                const int nx, const int ny, const int nm);
+
+/**
+ \brief Number of steps between checks of the free energy
+*/
+int adapt_interval();
+
+/**
+ \brief Next step to try, no longer than \a remaining
+
+ A step that would stop just short of \a remaining is split into two equal
+ ones, so a checkpoint is never reached by a sliver of a step.
+*/
+fp_t adapt_dt(const fp_t remaining);
+
+/**
+ \brief Keep a copy of \a conc, at time \a elapsed, to return to if the steps that follow are rejected
+*/
+void adapt_save(fp_t** conc, const fp_t elapsed);
+
+/**
+ \brief Judge the steps since adapt_save(), which took the free energy from
+ \a energy_old to \a energy_new and the time to \a elapsed
+
+ Rejects them if the energy rose by more than roundoff above the lowest value
+ accepted, or is not a number: \a conc and \a elapsed are put back as saved,
+ the step is halved, and 0 is returned. Once the step has been halved to a
+ millionth of the first one, the run stops with an error. Otherwise returns 1
+ and scales the next step by the ratio of the target decrease to the one per
+ step, by at most a factor of two either way.
+*/
+int adapt_accept(fp_t** conc, const fp_t energy_old, const fp_t energy_new, fp_t* elapsed);
+
+/**
+ \brief Log the current step, the range of steps accepted, and the count of
+ accepted and rejected steps since the last call, as a comment in \a output
+*/
+void adapt_log(FILE* output);
+
+/**
+ \brief Carry on from a restart at \a step, with the step adapt_log() wrote to \a name after that checkpoint
+
+ The controller keeps nothing else across a checkpoint, so a run restarted
+ from an exact checkpoint takes the same steps as one that never stopped.
+ Returns 0, leaving the first step as adapt_init() set it, if no such line
+ is found.
+*/
+int adapt_resume(const char* name, const int step);
+
+/**
+ \brief Release the copy of the field
+*/
+void adapt_free();
+
+/** \cond SuppressGuard */
+#endif /* _ADAPTIVE_H_ */
+/** \endcond */
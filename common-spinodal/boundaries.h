@@ -32,6 +32,32 @@ void apply_initial_conditions(fp_t** conc_old, const int nx, const int ny, const
 */
 void apply_boundary_conditions(fp_t** conc_old, const int nx, const int ny, const int nm);
 
+/**
+ \brief Worksharing body of apply_boundary_conditions(), for every thread of an enclosing parallel region
+
+ Ends with a barrier, so the ghost cells are ready to read on return. OpenMP
+ builds only.
+*/
+void apply_boundary_conditions_team(fp_t** conc_old, const int nx, const int ny, const int nm);
+
+/**
+ \brief Apply no-flux boundary conditions to row \a j of \a conc, just after it is computed
+
+ Fills the ghost columns of row \a j from the edge of the interior, and copies
+ the first and last interior rows into the ghost rows. Called by the thread
+ that wrote the row, inside the sweep, this leaves the field ready to be read
+ by the next stencil, with no separate apply_boundary_conditions() pass.
+*/
+void apply_boundary_row(fp_t** conc, const int j, const int nx, const int ny, const int nm);
+
+/**
+ \brief Apply boundary conditions to rows [\a jlo, \a jhi) of \a conc, by apply_boundary_row()
+
+ Leaves the rest of the field alone, so each thread can set the boundaries of
+ its own slab without waiting for the others.
+*/
+void apply_boundary_slab(fp_t** conc, const int jlo, const int jhi, const int nx, const int ny, const int nm);
+
 /** \cond SuppressGuard */
 #endif /* _BOUNDARIES_H_ */
 /** \endcond */
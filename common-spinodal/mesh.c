@@ -10,8 +10,129 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 #include "mesh.h"
 
+/**
+ \brief Whether touch_rows() may use OpenMP threads
+*/
+static int parallel_touch()
+{
+	#ifdef _OPENMP
+	const char* env = getenv("HIPERC_TOUCH");
+	return (env == NULL || strcmp(env, "serial") != 0);
+	#else
+	return 0;
+	#endif
+}
+
+/**
+ \brief Zero-fill rows, in parallel if OpenMP is enabled, with the static
+ row decomposition used by the stencil kernels
+*/
+static void touch_rows(fp_t** field, const int nx, const int ny, const int nm)
+{
+	const size_t row = (size_t)mesh_pitch(nx) * sizeof(fp_t);
+
+	#ifdef _OPENMP
+	#pragma omp parallel for schedule(static) if(parallel_touch())
+	#endif
+	for (int j = nm/2; j < ny-nm/2; j++)
+		memset(field[j], 0, row);
+
+	for (int j = 0; j < nm/2; j++) {
+		memset(field[j], 0, row);
+		memset(field[ny-1-j], 0, row);
+	}
+}
+
+/**
+ \brief Function make_field() uses to zero-fill, and so place, new arrays
+*/
+static touch_t first_touch = touch_rows;
+
+void set_first_touch(touch_t touch)
+{
+	first_touch = (touch == NULL) ? touch_rows : touch;
+}
+
+int mesh_huge_pages()
+{
+	#ifdef MADV_HUGEPAGE
+	const char* env = getenv("HIPERC_HUGEPAGES");
+	return (env != NULL && strcmp(env, "0") != 0);
+	#else
+	return 0;
+	#endif
+}
+
+const char* mesh_placement()
+{
+	static char text[64];
+	const char* touch = (first_touch != touch_rows) ? "backend"
+	                  : parallel_touch() ? "parallel" : "serial";
+
+	snprintf(text, sizeof(text), "touch=%s hugepages=%s", touch, mesh_huge_pages() ? "thp" : "off");
+
+	return text;
+}
+
+int mesh_pitch(const int nx)
+{
+	#ifdef DENSE_MESH
+	return nx;
+	#else
+	const int line = MESH_ALIGN / sizeof(fp_t);
+	int pitch = line * ((nx + line - 1) / line);
+
+	if ((pitch * sizeof(fp_t)) % MESH_CONFLICT == 0)
+		pitch += MESH_PAD / sizeof(fp_t);
+
+	return pitch;
+	#endif
+}
+
+fp_t** make_field(const int nx, const int ny, const int nm)
+{
+	const int pitch = mesh_pitch(nx);
+	const size_t size = (size_t)pitch * ny * sizeof(fp_t);
+	const size_t align = mesh_huge_pages() ? MESH_HUGE_PAGE : MESH_ALIGN;
+	const size_t bytes = align * ((size + align - 1) / align);
+	fp_t** field = (fp_t **)calloc(ny, sizeof(fp_t *));
+	void* data = aligned_alloc(align, bytes);
+
+	if (field == NULL || data == NULL) {
+		printf("Error: unable to allocate %zu bytes for a %i x %i mesh.\n", bytes, nx, ny);
+		exit(-1);
+	}
+
+	#ifdef MADV_HUGEPAGE
+	/* advisory only: without transparent huge pages, base pages are used */
+	if (mesh_huge_pages())
+		madvise(data, bytes, MADV_HUGEPAGE);
+	#endif
+
+	/* map 2D pointers onto 1D data */
+	field[0] = (fp_t *)data;
+	for (int j = 1; j < ny; j++)
+		field[j] = &field[0][(size_t)pitch * j];
+
+	/* the first write to each page decides which NUMA node holds it */
+	first_touch(field, nx, ny, nm);
+
+	return field;
+}
+
+void free_field(fp_t** field)
+{
+	if (field == NULL)
+		return;
+
+	free(field[0]);
+	free(field);
+}
+
 void make_arrays(fp_t*** conc_old, fp_t*** conc_new,
 				 fp_t*** conc_lap, fp_t*** conc_div,
 				 fp_t*** mask_lap,
@@ -19,28 +140,16 @@ void make_arrays(fp_t*** conc_old, fp_t*** conc_new,
 {
 	int i;
 
-	/* create 2D pointers */
-	*conc_old = (fp_t **)calloc(nx, sizeof(fp_t *));
-	*conc_new = (fp_t **)calloc(nx, sizeof(fp_t *));
-	*conc_lap = (fp_t **)calloc(nx, sizeof(fp_t *));
-	*conc_div = (fp_t **)calloc(nx, sizeof(fp_t *));
-	*mask_lap = (fp_t **)calloc(nm, sizeof(fp_t *));
+	*conc_old = make_field(nx, ny, nm);
+	*conc_new = make_field(nx, ny, nm);
+	if (conc_lap != NULL)
+		*conc_lap = make_field(nx, ny, nm);
+	if (conc_div != NULL)
+		*conc_div = make_field(nx, ny, nm);
 
-	/* allocate 1D data */
-	(*conc_old)[0] = (fp_t *)calloc(nx * ny, sizeof(fp_t));
-	(*conc_new)[0] = (fp_t *)calloc(nx * ny, sizeof(fp_t));
-	(*conc_lap)[0] = (fp_t *)calloc(nx * ny, sizeof(fp_t));
-	(*conc_div)[0] = (fp_t *)calloc(nx * ny, sizeof(fp_t));
+	*mask_lap = (fp_t **)calloc(nm, sizeof(fp_t *));
 	(*mask_lap)[0] = (fp_t *)calloc(nm * nm, sizeof(fp_t));
 
-	/* map 2D pointers onto 1D data */
-	for (i = 1; i < ny; i++) {
-		(*conc_old)[i] = &(*conc_old[0])[nx * i];
-		(*conc_new)[i] = &(*conc_new[0])[nx * i];
-		(*conc_lap)[i] = &(*conc_lap[0])[nx * i];
-		(*conc_div)[i] = &(*conc_div[0])[nx * i];
-	}
-
 	for (i = 1; i < nm; i++) {
 		(*mask_lap)[i] = &(*mask_lap[0])[nm * i];
 	}
@@ -50,17 +159,10 @@ void free_arrays(fp_t** conc_old, fp_t** conc_new,
 				 fp_t** conc_lap, fp_t** conc_div,
 				 fp_t** mask_lap)
 {
-	free(conc_old[0]);
-	free(conc_old);
-
-	free(conc_new[0]);
-	free(conc_new);
-
-	free(conc_lap[0]);
-	free(conc_lap);
-
-	free(conc_div[0]);
-	free(conc_div);
+	free_field(conc_old);
+	free_field(conc_new);
+	free_field(conc_lap);
+	free_field(conc_div);
 
 	free(mask_lap[0]);
 	free(mask_lap);
@@ -14,6 +14,11 @@
 #include <stdlib.h>
 #include "numerics.h"
 
+/**
+ \brief Row kernel matching the mask most recently written by set_mask()
+*/
+static stencil_row_t active_stencil = convolve_row_generic;
+
 void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, const int nm)
 {
     switch(code) {
@@ -32,6 +37,8 @@ void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, con
 
 	assert(nm <= MAX_MASK_W);
 	assert(nm <= MAX_MASK_H);
+
+	active_stencil = select_stencil(code, nm);
 }
 
 void five_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap, const int nm)
@@ -85,6 +92,112 @@ void biharmonic_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap, const int
 	mask_lap[4][2] =  1. / (dy * dy); /* lower-lower-middle */
 }
 
+void convolve_row_generic(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                          const int j, const int ilo, const int ihi, const int nm)
+{
+	for (int i = ilo; i < ihi; i++) {
+		fp_t value = 0.0;
+		for (int mj = -nm/2; mj < nm/2+1; mj++) {
+			for (int mi = -nm/2; mi < nm/2+1; mi++) {
+				value += mask_lap[mj+nm/2][mi+nm/2] * conc[j+mj][i+mi];
+			}
+		}
+		conc_row[i] = value;
+	}
+}
+
+/**
+ \brief Row kernel for five_point_Laplacian_stencil()
+*/
+static void convolve_row_53(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                            const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t* restrict up  = conc[j-1];
+	const fp_t* restrict mid = conc[j];
+	const fp_t* restrict dn  = conc[j+1];
+
+	const fp_t n = mask_lap[0][1];
+	const fp_t w = mask_lap[1][0], c = mask_lap[1][1], e = mask_lap[1][2];
+	const fp_t s = mask_lap[2][1];
+
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = n * up[i] + w * mid[i-1] + c * mid[i] + e * mid[i+1] + s * dn[i];
+}
+
+/**
+ \brief Row kernel for nine_point_Laplacian_stencil()
+*/
+static void convolve_row_93(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                            const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t* restrict up  = conc[j-1];
+	const fp_t* restrict mid = conc[j];
+	const fp_t* restrict dn  = conc[j+1];
+
+	const fp_t nw = mask_lap[0][0], n = mask_lap[0][1], ne = mask_lap[0][2];
+	const fp_t w  = mask_lap[1][0], c = mask_lap[1][1], e  = mask_lap[1][2];
+	const fp_t sw = mask_lap[2][0], s = mask_lap[2][1], se = mask_lap[2][2];
+
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = nw * up[i-1]  + n * up[i]  + ne * up[i+1]
+		            + w  * mid[i-1] + c * mid[i] + e  * mid[i+1]
+		            + sw * dn[i-1]  + s * dn[i]  + se * dn[i+1];
+}
+
+/**
+ \brief Row kernel for biharmonic_stencil()
+*/
+static void convolve_row_135(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                             const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t* restrict uu  = conc[j-2];
+	const fp_t* restrict up  = conc[j-1];
+	const fp_t* restrict mid = conc[j];
+	const fp_t* restrict dn  = conc[j+1];
+	const fp_t* restrict dd  = conc[j+2];
+
+	const fp_t nn = mask_lap[0][2];
+	const fp_t nw = mask_lap[1][1], n = mask_lap[1][2], ne = mask_lap[1][3];
+	const fp_t ww = mask_lap[2][0], w = mask_lap[2][1], c = mask_lap[2][2], e = mask_lap[2][3], ee = mask_lap[2][4];
+	const fp_t sw = mask_lap[3][1], s = mask_lap[3][2], se = mask_lap[3][3];
+	const fp_t ss = mask_lap[4][2];
+
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = nn * uu[i]
+		            + nw * up[i-1] + n * up[i] + ne * up[i+1]
+		            + ww * mid[i-2] + w * mid[i-1] + c * mid[i] + e * mid[i+1] + ee * mid[i+2]
+		            + sw * dn[i-1] + s * dn[i] + se * dn[i+1]
+		            + ss * dd[i];
+}
+
+/**
+ \brief Specialized row kernels, keyed on mask code and size
+*/
+static const struct {
+	int code;
+	int nm;
+	stencil_row_t kernel;
+} stencil_table[] = {
+	{53, 3, convolve_row_53},
+	{93, 3, convolve_row_93},
+	{135, 5, convolve_row_135}
+};
+
+stencil_row_t select_stencil(const int code, const int nm)
+{
+	for (size_t n = 0; n < sizeof(stencil_table) / sizeof(stencil_table[0]); n++)
+		if (stencil_table[n].code == code && stencil_table[n].nm == nm)
+			return stencil_table[n].kernel;
+
+	return convolve_row_generic;
+}
+
+void convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                  const int j, const int ilo, const int ihi, const int nm)
+{
+	active_stencil(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+}
+
 fp_t grad_sq(fp_t** conc, const int x, const int y,
 			 const fp_t dx, const fp_t dy,
 			 const int nx, const int ny)
@@ -128,39 +241,76 @@ fp_t chem_energy(const fp_t C)
 	return rho * A*A * B*B;
 }
 
-void free_energy(fp_t** conc_new, fp_t** conc_lap,
-				 const fp_t dx, const fp_t dy,
-				 const int nx, const int ny, const int nm,
-				 const fp_t kappa, fp_t* energy)
+fp_t well_curvature()
+{
+	const fp_t Ca  = 0.3;
+	const fp_t Cb  = 0.7;
+	const fp_t rho = 5.0;
+
+	return 2.0 * rho * (Cb - Ca) * (Cb - Ca);
+}
+
+fp_t energy_row(fp_t** conc_new, const int j,
+                const fp_t dx, const fp_t dy,
+                const int nx, const int nm, const fp_t kappa)
 {
+	const fp_t* restrict row = conc_new[j];
+	const fp_t* restrict up = conc_new[j+1];
+	const fp_t* restrict down = conc_new[j-1];
 	const fp_t dV = dx * dy;
-	int i, j;
-	fp_t sum=0.;
+	fp_t sum = 0.;
+	int i;
 
-	#ifdef __OPENMP
-	#pragma omp parallel reduction(+:sum)
-	{
-		#pragma omp for collapse(2) private (i,j)
+	/* same arithmetic as chem_energy() and grad_sq(), inlined for vectorization */
+	#ifdef _OPENMP
+	#pragma omp simd reduction(+:sum)
 	#endif
-		for (j = nm/2; j < ny-nm/2; j++) {
-			for (i = nm/2; i < nx-nm/2; i++) {
-				const fp_t f = chem_energy(conc_new[j][i]);
-				const fp_t g = grad_sq(conc_new, i, j, dx, dy, nx, ny);
-				conc_lap[j][i] = dV * (f + 0.5 * kappa * g);
-			}
-		}
+	for (i = nm/2; i < nx-nm/2; i++) {
+		const fp_t f = chem_energy(row[i]);
+		const fp_t g = (row[i+1] - row[i-1]) * (row[i+1] - row[i-1]) / (4. * dx * dx)
+		             + (up[i] - down[i]) * (up[i] - down[i]) / (4. * dy * dy);
+		sum += dV * (f + 0.5 * kappa * g);
+	}
 
-		#ifdef __OPENMP
-		#pragma omp for collapse(2) private(i,j)
-		#endif
-		for (j = nm/2; j < ny-nm/2; j++) {
-			for (i = nm/2; i < nx-nm/2; i++) {
-				sum += conc_lap[j][i];
-			}
-		}
-	#ifdef __OPENMP
+	return sum;
+}
+
+void free_energy_team(fp_t** conc_new,
+                      const fp_t dx, const fp_t dy,
+                      const int nx, const int ny, const int nm,
+                      const fp_t kappa, fp_t* partial, fp_t* energy)
+{
+	int j;
+
+	#ifdef _OPENMP
+	#pragma omp for schedule(static)
+	#endif
+	for (j = nm/2; j < ny-nm/2; j++)
+		partial[j] = energy_row(conc_new, j, dx, dy, nx, nm, kappa);
+
+	/* add rows in order, so the sum does not depend on the thread count */
+	#ifdef _OPENMP
+	#pragma omp single
+	#endif
+	{
+		fp_t sum = 0.;
+		for (j = nm/2; j < ny-nm/2; j++)
+			sum += partial[j];
+		*energy = sum;
 	}
+}
+
+void free_energy(fp_t** conc_new,
+				 const fp_t dx, const fp_t dy,
+				 const int nx, const int ny, const int nm,
+				 const fp_t kappa, fp_t* energy)
+{
+	fp_t* partial = (fp_t*)malloc(ny * sizeof(fp_t));
+
+	#ifdef _OPENMP
+	#pragma omp parallel
 	#endif
+	free_energy_team(conc_new, dx, dy, nx, ny, nm, kappa, partial, energy);
 
-	*energy = sum;
+	free(partial);
 }
@@ -40,6 +40,10 @@
 
  If your stencil is larger than \f$ 5\times 5\f$, you must increase the values
  defined by #MAX_MASK_W and #MAX_MASK_H.
+
+ This also selects the row kernel used by convolve_row(). For best performance,
+ write a kernel specialized for your mask and add it to the table searched by
+ select_stencil(); otherwise, convolve_row_generic() is used.
 */
 void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, const int nm);
 
@@ -64,6 +68,39 @@ void nine_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap,
 */
 void biharmonic_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap, const int nm);
 
+/**
+ \brief Convolve the mask with rows \a j-nm/2 through \a j+nm/2 of \a conc,
+ writing columns \a ilo through \a ihi-1 of \a conc_row
+
+ Kernels of this type are specialized for the footprint of a given mask: the
+ zero entries are skipped entirely, and the non-zero coefficients are read
+ once per row rather than once per point.
+*/
+typedef void (*stencil_row_t)(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                              const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Look up the row kernel specialized for the mask \a code
+
+ Codes with no specialized kernel, or a mask size \a nm that does not match
+ the code, get convolve_row_generic().
+*/
+stencil_row_t select_stencil(const int code, const int nm);
+
+/**
+ \brief Convolve one row using the kernel selected by the last call to set_mask()
+
+ This is the row-wise building block for compute_laplacian() and compute_divergence().
+*/
+void convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                  const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Convolve one row with an arbitrary \f$ nm\times nm\f$ mask
+*/
+void convolve_row_generic(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                          const int j, const int ilo, const int ihi, const int nm);
+
 /**
    \brief Compute interior Laplacian from old composition data
 */
@@ -83,6 +120,119 @@ void update_composition(fp_t** conc_old, fp_t** conc_div, fp_t** conc_new,
                         const int nx, const int ny, const int nm,
                         const fp_t D, const fp_t dt);
 
+/**
+ \brief Update composition field in a single sweep, fusing compute_laplacian(),
+ compute_divergence(), and update_composition()
+
+ Each thread marches through a contiguous slab of rows, holding only the \a nm
+ most recent rows of the chemical potential in its own rolling window within
+ \a conc_win (\a nm rows of \a nx values per thread). No-flux conditions on the
+ chemical potential are applied by clamping row and column indices into the
+ interior, so \a conc_lap and \a conc_div are never written. Boundary
+ conditions must already be applied to \a conc_old.
+*/
+void compute_fused_step(fp_t** conc_old, fp_t* conc_win, fp_t** conc_new,
+                        fp_t** const mask_lap, const fp_t kappa,
+                        const int nx, const int ny, const int nm,
+                        const fp_t M, const fp_t dt);
+
+/**
+ \brief Worksharing body of compute_laplacian(), for every thread of an enclosing parallel region
+
+ Ends with a barrier, since the divergence reads neighboring rows. OpenMP
+ builds only, as are the other \c _team functions.
+*/
+void compute_laplacian_team(fp_t** const conc_old, fp_t** conc_lap, fp_t** const mask_lap,
+                            const fp_t kappa, const int nx, const int ny, const int nm);
+
+/**
+ \brief Worksharing body of compute_divergence(), without a closing barrier
+
+ update_composition_team(), with the same static schedule, only reads rows of
+ \a conc_div that the same thread wrote.
+*/
+void compute_divergence_team(fp_t** conc_lap, fp_t** conc_div, fp_t** const mask_lap,
+                             const int nx, const int ny, const int nm);
+
+/**
+ \brief Worksharing body of update_composition(), without a closing barrier
+*/
+void update_composition_team(fp_t** conc_old, fp_t** conc_div, fp_t** conc_new,
+                             const int nx, const int ny, const int nm,
+                             const fp_t D, const fp_t dt);
+
+/**
+ \brief Body of compute_fused_step(), run by every thread of an enclosing parallel region
+
+ Ends without a barrier; the caller must add one before \a conc_new is read
+ across rows.
+*/
+void compute_fused_step_team(fp_t** conc_old, fp_t* conc_win, fp_t** conc_new,
+                             fp_t** const mask_lap, const fp_t kappa,
+                             const int nx, const int ny, const int nm,
+                             const fp_t M, const fp_t dt);
+
+/**
+ \brief Chemical potential of rows [\a jlo, \a jhi) only, with their boundary conditions
+
+ Unlike compute_laplacian_team(), this always applies apply_boundary_row() to
+ each row of \a conc_lap, since there is no team-wide pass afterwards. OpenMP
+ builds only, as are the other \c _slab functions.
+*/
+void compute_laplacian_slab(fp_t** const conc_old, fp_t** conc_lap, fp_t** const mask_lap,
+                            const fp_t kappa, const int jlo, const int jhi,
+                            const int nx, const int ny, const int nm);
+
+/**
+ \brief Divergence of rows [\a jlo, \a jhi) only
+*/
+void compute_divergence_slab(fp_t** conc_lap, fp_t** conc_div, fp_t** const mask_lap,
+                             const int jlo, const int jhi, const int nx, const int nm);
+
+/**
+ \brief Update rows [\a jlo, \a jhi) only, from rows the same thread differentiated
+*/
+void update_composition_slab(fp_t** conc_old, fp_t** conc_div, fp_t** conc_new,
+                             const int jlo, const int jhi,
+                             const int nx, const int ny, const int nm,
+                             const fp_t D, const fp_t dt);
+
+/**
+ \brief Prepare the Fourier transforms and wavenumbers for a periodic mesh
+
+ The transformed domain is the interior, \a nx-2(\a nm/2) by \a ny-2(\a nm/2)
+ points, which transforms fastest when both sides factor into small primes.
+ The Laplacian in Fourier space is the symbol of \a mask_lap for the five- and
+ nine-point stencils (codes 53 and 93), so results converge to the
+ finite-difference solution; any other \a code uses the exact wavenumbers.
+ Spectral builds only.
+*/
+void spectral_init(fp_t** const mask_lap, const int code,
+                   const fp_t dx, const fp_t dy,
+                   const int nx, const int ny, const int nm);
+
+/**
+ \brief Transform the composition and chemical potential of \a conc_old
+
+ Both real fields are packed into one complex transform. Spectral builds only.
+*/
+void compute_spectral_transform(fp_t** conc_old, const int nx, const int ny, const int nm);
+
+/**
+ \brief Advance the transformed field by \a dt and write it to \a conc_new
+
+ The biharmonic term, and a stabilizing term \f$ S\nabla^2 c \f$ balanced by
+ its explicit counterpart, are implicit; \f$ \partial f/\partial c \f$ is
+ explicit. Ghost cells are not set. Spectral builds only.
+*/
+void update_spectral_composition(fp_t** conc_new, const int nx, const int ny, const int nm,
+                                 const fp_t M, const fp_t kappa, const fp_t dt);
+
+/**
+ \brief Release the memory held by spectral_init(). Spectral builds only.
+*/
+void spectral_free();
+
 /**
    \brief Compute gradient-squared, truncation error \f$\mathcal{O}(\Delta x^2)\f$
 */
@@ -95,10 +245,37 @@ fp_t grad_sq(fp_t** conc, const int x, const int y,
 */
 fp_t chem_energy(const fp_t C);
 
+/**
+ \brief Curvature of chem_energy() at its minima, \f$ 2\rho(C_b - C_a)^2 \f$
+*/
+fp_t well_curvature();
+
+/**
+ \brief Free energy of row \a j, summed over the points covered by free_energy()
+*/
+fp_t energy_row(fp_t** conc_new, const int j,
+                const fp_t dx, const fp_t dy,
+                const int nx, const int nm, const fp_t kappa);
+
+/**
+ \brief Worksharing body of free_energy(), for every thread of an enclosing parallel region
+
+ Every thread must call it with the same \a partial, scratch for \a ny values.
+ Ends with a barrier, after which \a energy is set.
+*/
+void free_energy_team(fp_t** conc_new,
+                      const fp_t dx, const fp_t dy,
+                      const int nx, const int ny, const int nm,
+                      const fp_t kappa, fp_t* partial, fp_t* energy);
+
 /**
  \brief Compute total free energy
+
+ Rows are reduced in parallel, when OpenMP is available, and their sums added
+ in order, so the result is the same for any number of threads. No scratch
+ field is written.
 */
-void free_energy(fp_t** conc_new, fp_t** conc_lap,
+void free_energy(fp_t** conc_new,
                  const fp_t dx, const fp_t dy,
                  const int nx, const int ny, const int nm,
                  const fp_t kappa, fp_t* energy);
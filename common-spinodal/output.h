@@ -13,8 +13,77 @@
 #define _OUTPUT_H_
 /** \endcond */
 
+#include <stdint.h>
 #include "type.h"
 
+/**
+ \brief Leading bytes of every binary checkpoint file
+*/
+#define CHECKPOINT_MAGIC "HiPerC\x1a\n"
+
+/**
+ \brief Version of the binary checkpoint layout
+*/
+#define CHECKPOINT_VERSION 1
+
+/**
+ \brief Edge length of the square tiles compressed independently in a lossy checkpoint
+*/
+#define CHECKPOINT_TILE 128
+
+/**
+ \brief Encodings of the field in a checkpoint file
+*/
+enum checkpoint_codec {
+	CODEC_RAW       = 0, /**< values as stored in memory */
+	CODEC_QUANTIZED = 1  /**< error-bounded quantization, prediction, and deflate, by tile */
+};
+
+/**
+ \brief Header of a binary checkpoint file
+
+ With #CODEC_RAW, the 64-byte header is followed immediately by \a ny rows of
+ \a nx values, each \a fp_width bytes wide, in native byte order. Halo cells are included,
+ so a restart resumes exactly where the run left off. Since the data start on
+ a 64-byte boundary, the field can be mapped straight into memory, \a e.g.
+ with NumPy:
+ \code
+ hdr = np.fromfile(name, dtype=np.int32, count=8)
+ c = np.memmap(name, dtype="f%d" % hdr[3], mode="r", offset=64, shape=(hdr[5], hdr[4]))
+ \endcode
+*/
+struct Checkpoint {
+	char magic[8];    /**< #CHECKPOINT_MAGIC */
+	int32_t version;  /**< #CHECKPOINT_VERSION */
+	int32_t fp_width; /**< size of \c fp_t in bytes */
+	int32_t nx;       /**< mesh points along \a x, including halo */
+	int32_t ny;       /**< mesh points along \a y, including halo */
+	int32_t nm;       /**< mask size, which sets the halo width */
+	int32_t codec;    /**< #checkpoint_codec of the data following the header */
+	double dx;        /**< mesh resolution along \a x */
+	double dy;        /**< mesh resolution along \a y */
+	double elapsed;   /**< simulation time */
+	int64_t step;     /**< timestep number */
+};
+
+/**
+ \brief Second header of a #CODEC_QUANTIZED checkpoint
+
+ Follows struct Checkpoint, and is itself followed by \a ntiles 64-bit
+ compressed sizes, then the compressed tiles. Tiles are #CHECKPOINT_TILE
+ points square, numbered row by row, and clipped at the edge of the mesh.
+ Each is a zlib stream of varint codes, one per point: zero followed by the raw
+ value, or one more than the zig-zag encoded difference between the value, in
+ multiples of twice the tolerance, and the sum of its west and north
+ neighbors less its north-west neighbor. Neighbors outside the tile, and raw
+ values, count as zero.
+*/
+struct CheckpointTiles {
+	double tolerance; /**< absolute error bound */
+	int32_t tile;     /**< #CHECKPOINT_TILE */
+	int32_t ntiles;   /**< number of tiles */
+};
+
 /**
  \brief Read parameters from file specified on the command line
 */
@@ -36,15 +105,50 @@ void param_parser(int argc, char* argv[], int* bx, int* by, int* checks, int* co
 void print_progress(const int step, const int steps);
 
 /**
- \brief Writes scalar composition field to diffusion.???????.csv
+ \brief Writes scalar composition field to spinodal.???????.csv
+
+ Blocks of rows are formatted in parallel, when OpenMP is available, by a
+ formatter that reproduces \c printf("%f") exactly, then written in order
+ with one large write per block.
 */
 void write_csv(fp_t** conc, const int nx, const int ny, const fp_t dx, const fp_t dy, const int step);
 
 /**
- \brief Writes scalar composition field to diffusion.???????.png
+ \brief Writes scalar composition field to spinodal.???????.png
+
+ The range search, quantization, and row filtering are threaded with OpenMP
+ when available. Rows are then deflated in independent strips, in parallel,
+ and the strips joined into one zlib stream, so large images no longer
+ compress on a single core. Set \c HIPERC_PNG_LEVEL to a zlib level (0-9) and
+ \c HIPERC_PNG_FILTER to \c none, \c sub, \c up, \c avg, \c paeth, or
+ \c adaptive (the default) to trade file size for speed.
 */
 void write_png(fp_t** conc, const int nx, const int ny, const int step);
 
+/**
+ \brief Writes scalar composition field to spinodal.???????.dat
+
+ See struct Checkpoint for the layout. The file is written under a temporary
+ name and renamed once complete, so a run preempted mid-write never leaves a
+ truncated checkpoint behind. If the environment variable
+ \c HIPERC_CHECKPOINT_TOLERANCE is set to a positive number, the field is
+ compressed in parallel, tile by tile, with every value held to within that
+ absolute error (see struct CheckpointTiles); otherwise it is stored exactly.
+*/
+void write_checkpoint(fp_t** conc, const int nx, const int ny, const int nm,
+                      const fp_t dx, const fp_t dy, const int step, const fp_t elapsed);
+
+/**
+ \brief Reads scalar composition field from a checkpoint written by write_checkpoint()
+
+ The file is mapped into memory rather than read through a buffer. The mesh
+ size, mask size, and width of \c fp_t must match the current run; \a step and
+ \a elapsed are set from the header. Compressed checkpoints are decoded in
+ parallel.
+*/
+void read_checkpoint(const char* name, fp_t** conc, const int nx, const int ny, const int nm,
+                     const fp_t dx, const fp_t dy, int* step, fp_t* elapsed);
+
 /** \cond SuppressGuard */
 #endif /* _OUTPUT_H_ */
 /** \endcond */
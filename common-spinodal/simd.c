@@ -0,0 +1,478 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  simd.c
+ \brief Implementation of explicitly vectorized row kernels for spinodal decomposition benchmarks
+
+ Each kernel is compiled for SSE2, AVX2, and AVX-512 using GCC target
+ attributes, so one executable carries all three; simd_init() picks one at
+ startup. Compile with \c -ffp-contract=off: fused multiply-adds would change
+ rounding relative to the scalar kernels.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "numerics.h"
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86
+#endif
+
+/**
+ \brief Row kernel for the instruction set chosen by simd_init()
+*/
+static stencil_row_t simd_stencil = convolve_row;
+
+/**
+ \brief Row update for the instruction set chosen by simd_init()
+*/
+typedef void (*update_row_t)(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                             const int ilo, const int ihi, const fp_t alpha);
+
+static void update_row_scalar(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                              const int ilo, const int ihi, const fp_t alpha)
+{
+	for (int i = ilo; i < ihi; i++)
+		conc_new[i] = conc_old[i] + alpha * conc_div[i];
+}
+
+static update_row_t simd_update = update_row_scalar;
+
+/**
+ \brief Chemical potential row for the instruction set chosen by simd_init()
+*/
+typedef void (*potential_row_t)(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                                const fp_t kappa, const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Chemical potential from composition and its Laplacian, matching dfdc()
+ in the backends
+*/
+static fp_t potential(const fp_t C, const fp_t lap, const fp_t kappa)
+{
+	const fp_t Ca  = 0.3;
+	const fp_t Cb  = 0.7;
+	const fp_t rho = 5.0;
+
+	const fp_t A = C - Ca;
+	const fp_t B = Cb - C;
+
+	return 2.0 * rho * A * B * (Ca + Cb - 2.0 * C) - kappa * lap;
+}
+
+static void potential_row_scalar(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                                 const fp_t kappa, const int j, const int ilo, const int ihi, const int nm)
+{
+	convolve_row(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = potential(conc[j][i], conc_row[i], kappa);
+}
+
+static potential_row_t simd_potential = potential_row_scalar;
+
+static enum simd_isa simd_level = ISA_SCALAR;
+
+#ifdef SIMD_X86
+
+/**
+ \brief Flatten the non-zero entries of the mask into a list of taps
+
+ Each tap pairs a coefficient with a pointer to the neighbor of column 0 that
+ it multiplies, so that \a src[t][i] is the neighbor of \a conc[j][i]. Taps are
+ listed in row-major order, matching the summation order of the scalar kernels.
+*/
+static int gather_taps(fp_t** const conc, fp_t** const mask_lap, const int j, const int nm,
+                       const double** src, double* coef)
+{
+	int nt = 0;
+
+	for (int mj = -nm/2; mj < nm/2+1; mj++) {
+		for (int mi = -nm/2; mi < nm/2+1; mi++) {
+			const fp_t w = mask_lap[mj+nm/2][mi+nm/2];
+			if (w != 0.) {
+				src[nt] = (const double*)(conc[j+mj] + mi);
+				coef[nt] = w;
+				nt++;
+			}
+		}
+	}
+
+	if (nt == 0) {
+		/* all-zero mask: one zero tap keeps the kernels branch-free */
+		src[nt] = (const double*)conc[j];
+		coef[nt] = 0.;
+		nt++;
+	}
+
+	return nt;
+}
+
+/**
+ \brief Finish a row with scalar arithmetic, in tap order
+*/
+static void convolve_tail(const double** src, const double* coef, const int nt,
+                          double* conc_row, const int ilo, const int ihi)
+{
+	for (int i = ilo; i < ihi; i++) {
+		double value = coef[0] * src[0][i];
+		for (int t = 1; t < nt; t++)
+			value += coef[t] * src[t][i];
+		conc_row[i] = value;
+	}
+}
+
+__attribute__((target("sse2")))
+static void convolve_row_sse2(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                              const int j, const int ilo, const int ihi, const int nm)
+{
+	const double* src[MAX_MASK_W * MAX_MASK_H];
+	double coef[MAX_MASK_W * MAX_MASK_H];
+	const int nt = gather_taps(conc, mask_lap, j, nm, src, coef);
+	double* row = (double*)conc_row;
+	int i = ilo;
+
+	for (; i + 2 <= ihi; i += 2) {
+		__m128d acc = _mm_mul_pd(_mm_set1_pd(coef[0]), _mm_loadu_pd(&src[0][i]));
+		for (int t = 1; t < nt; t++)
+			acc = _mm_add_pd(acc, _mm_mul_pd(_mm_set1_pd(coef[t]), _mm_loadu_pd(&src[t][i])));
+		_mm_storeu_pd(&row[i], acc);
+	}
+
+	convolve_tail(src, coef, nt, row, i, ihi);
+}
+
+__attribute__((target("avx2")))
+static void convolve_row_avx2(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                              const int j, const int ilo, const int ihi, const int nm)
+{
+	const double* src[MAX_MASK_W * MAX_MASK_H];
+	double coef[MAX_MASK_W * MAX_MASK_H];
+	const int nt = gather_taps(conc, mask_lap, j, nm, src, coef);
+	double* row = (double*)conc_row;
+	int i = ilo;
+
+	for (; i + 4 <= ihi; i += 4) {
+		__m256d acc = _mm256_mul_pd(_mm256_set1_pd(coef[0]), _mm256_loadu_pd(&src[0][i]));
+		for (int t = 1; t < nt; t++)
+			acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_set1_pd(coef[t]), _mm256_loadu_pd(&src[t][i])));
+		_mm256_storeu_pd(&row[i], acc);
+	}
+
+	convolve_tail(src, coef, nt, row, i, ihi);
+}
+
+__attribute__((target("avx512f")))
+static void convolve_row_avx512(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                                const int j, const int ilo, const int ihi, const int nm)
+{
+	const double* src[MAX_MASK_W * MAX_MASK_H];
+	double coef[MAX_MASK_W * MAX_MASK_H];
+	const int nt = gather_taps(conc, mask_lap, j, nm, src, coef);
+	double* row = (double*)conc_row;
+	int i = ilo;
+
+	for (; i + 8 <= ihi; i += 8) {
+		__m512d acc = _mm512_mul_pd(_mm512_set1_pd(coef[0]), _mm512_loadu_pd(&src[0][i]));
+		for (int t = 1; t < nt; t++)
+			acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_set1_pd(coef[t]), _mm512_loadu_pd(&src[t][i])));
+		_mm512_storeu_pd(&row[i], acc);
+	}
+
+	convolve_tail(src, coef, nt, row, i, ihi);
+}
+
+#ifdef STREAM
+/**
+ \brief Number of leading columns to peel so that \a row[ilo+peel] is aligned
+ to \a bytes, as non-temporal stores require
+*/
+static int peel_to(const double* row, const int ilo, const int ihi, const size_t bytes)
+{
+	int peel = 0;
+
+	while (ilo + peel < ihi && ((uintptr_t)&row[ilo + peel]) % bytes != 0)
+		peel++;
+
+	return peel;
+}
+#endif
+
+__attribute__((target("sse2")))
+static void update_row_sse2(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                            const int ilo, const int ihi, const fp_t alpha)
+{
+	const double* old = (const double*)conc_old;
+	const double* rhs = (const double*)conc_div;
+	double* dst = (double*)conc_new;
+	const __m128d a = _mm_set1_pd(alpha);
+	int i = ilo;
+
+	#ifdef STREAM
+	for (const int i0 = ilo + peel_to(dst, ilo, ihi, 16); i < i0; i++)
+		dst[i] = old[i] + alpha * rhs[i];
+	for (; i + 2 <= ihi; i += 2)
+		_mm_stream_pd(&dst[i], _mm_add_pd(_mm_loadu_pd(&old[i]), _mm_mul_pd(a, _mm_loadu_pd(&rhs[i]))));
+	#else
+	for (; i + 2 <= ihi; i += 2)
+		_mm_storeu_pd(&dst[i], _mm_add_pd(_mm_loadu_pd(&old[i]), _mm_mul_pd(a, _mm_loadu_pd(&rhs[i]))));
+	#endif
+
+	for (; i < ihi; i++)
+		dst[i] = old[i] + alpha * rhs[i];
+}
+
+__attribute__((target("avx2")))
+static void update_row_avx2(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                            const int ilo, const int ihi, const fp_t alpha)
+{
+	const double* old = (const double*)conc_old;
+	const double* rhs = (const double*)conc_div;
+	double* dst = (double*)conc_new;
+	const __m256d a = _mm256_set1_pd(alpha);
+	int i = ilo;
+
+	#ifdef STREAM
+	for (const int i0 = ilo + peel_to(dst, ilo, ihi, 32); i < i0; i++)
+		dst[i] = old[i] + alpha * rhs[i];
+	for (; i + 4 <= ihi; i += 4)
+		_mm256_stream_pd(&dst[i], _mm256_add_pd(_mm256_loadu_pd(&old[i]), _mm256_mul_pd(a, _mm256_loadu_pd(&rhs[i]))));
+	#else
+	for (; i + 4 <= ihi; i += 4)
+		_mm256_storeu_pd(&dst[i], _mm256_add_pd(_mm256_loadu_pd(&old[i]), _mm256_mul_pd(a, _mm256_loadu_pd(&rhs[i]))));
+	#endif
+
+	for (; i < ihi; i++)
+		dst[i] = old[i] + alpha * rhs[i];
+}
+
+__attribute__((target("avx512f")))
+static void update_row_avx512(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                              const int ilo, const int ihi, const fp_t alpha)
+{
+	const double* old = (const double*)conc_old;
+	const double* rhs = (const double*)conc_div;
+	double* dst = (double*)conc_new;
+	const __m512d a = _mm512_set1_pd(alpha);
+	int i = ilo;
+
+	#ifdef STREAM
+	for (const int i0 = ilo + peel_to(dst, ilo, ihi, 64); i < i0; i++)
+		dst[i] = old[i] + alpha * rhs[i];
+	for (; i + 8 <= ihi; i += 8)
+		_mm512_stream_pd(&dst[i], _mm512_add_pd(_mm512_loadu_pd(&old[i]), _mm512_mul_pd(a, _mm512_loadu_pd(&rhs[i]))));
+	#else
+	for (; i + 8 <= ihi; i += 8)
+		_mm512_storeu_pd(&dst[i], _mm512_add_pd(_mm512_loadu_pd(&old[i]), _mm512_mul_pd(a, _mm512_loadu_pd(&rhs[i]))));
+	#endif
+
+	for (; i < ihi; i++)
+		dst[i] = old[i] + alpha * rhs[i];
+}
+
+__attribute__((target("sse2")))
+static void potential_row_sse2(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                               const fp_t kappa, const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t Ca  = 0.3;
+	const fp_t Cb  = 0.7;
+	const fp_t rho = 5.0;
+
+	const __m128d ca = _mm_set1_pd(Ca);
+	const __m128d cb = _mm_set1_pd(Cb);
+	const __m128d cs = _mm_set1_pd(Ca + Cb);
+	const __m128d two = _mm_set1_pd(2.0);
+	const __m128d scale = _mm_set1_pd(2.0 * rho);
+	const __m128d k = _mm_set1_pd(kappa);
+	const double* mid = (const double*)conc[j];
+	double* row = (double*)conc_row;
+	int i = ilo;
+
+	convolve_row_sse2(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+
+	for (; i + 2 <= ihi; i += 2) {
+		const __m128d C = _mm_loadu_pd(&mid[i]);
+		const __m128d A = _mm_sub_pd(C, ca);
+		const __m128d B = _mm_sub_pd(cb, C);
+		const __m128d mu = _mm_mul_pd(_mm_mul_pd(_mm_mul_pd(scale, A), B), _mm_sub_pd(cs, _mm_mul_pd(two, C)));
+		_mm_storeu_pd(&row[i], _mm_sub_pd(mu, _mm_mul_pd(k, _mm_loadu_pd(&row[i]))));
+	}
+
+	for (; i < ihi; i++)
+		row[i] = potential(mid[i], row[i], kappa);
+}
+
+__attribute__((target("avx2")))
+static void potential_row_avx2(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                               const fp_t kappa, const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t Ca  = 0.3;
+	const fp_t Cb  = 0.7;
+	const fp_t rho = 5.0;
+
+	const __m256d ca = _mm256_set1_pd(Ca);
+	const __m256d cb = _mm256_set1_pd(Cb);
+	const __m256d cs = _mm256_set1_pd(Ca + Cb);
+	const __m256d two = _mm256_set1_pd(2.0);
+	const __m256d scale = _mm256_set1_pd(2.0 * rho);
+	const __m256d k = _mm256_set1_pd(kappa);
+	const double* mid = (const double*)conc[j];
+	double* row = (double*)conc_row;
+	int i = ilo;
+
+	convolve_row_avx2(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+
+	for (; i + 4 <= ihi; i += 4) {
+		const __m256d C = _mm256_loadu_pd(&mid[i]);
+		const __m256d A = _mm256_sub_pd(C, ca);
+		const __m256d B = _mm256_sub_pd(cb, C);
+		const __m256d mu = _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(scale, A), B), _mm256_sub_pd(cs, _mm256_mul_pd(two, C)));
+		_mm256_storeu_pd(&row[i], _mm256_sub_pd(mu, _mm256_mul_pd(k, _mm256_loadu_pd(&row[i]))));
+	}
+
+	for (; i < ihi; i++)
+		row[i] = potential(mid[i], row[i], kappa);
+}
+
+__attribute__((target("avx512f")))
+static void potential_row_avx512(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                                 const fp_t kappa, const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t Ca  = 0.3;
+	const fp_t Cb  = 0.7;
+	const fp_t rho = 5.0;
+
+	const __m512d ca = _mm512_set1_pd(Ca);
+	const __m512d cb = _mm512_set1_pd(Cb);
+	const __m512d cs = _mm512_set1_pd(Ca + Cb);
+	const __m512d two = _mm512_set1_pd(2.0);
+	const __m512d scale = _mm512_set1_pd(2.0 * rho);
+	const __m512d k = _mm512_set1_pd(kappa);
+	const double* mid = (const double*)conc[j];
+	double* row = (double*)conc_row;
+	int i = ilo;
+
+	convolve_row_avx512(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+
+	for (; i + 8 <= ihi; i += 8) {
+		const __m512d C = _mm512_loadu_pd(&mid[i]);
+		const __m512d A = _mm512_sub_pd(C, ca);
+		const __m512d B = _mm512_sub_pd(cb, C);
+		const __m512d mu = _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(scale, A), B), _mm512_sub_pd(cs, _mm512_mul_pd(two, C)));
+		_mm512_storeu_pd(&row[i], _mm512_sub_pd(mu, _mm512_mul_pd(k, _mm512_loadu_pd(&row[i]))));
+	}
+
+	for (; i < ihi; i++)
+		row[i] = potential(mid[i], row[i], kappa);
+}
+
+#endif /* SIMD_X86 */
+
+/**
+ \brief Instruction set requested through the \c HIPERC_ISA environment variable
+*/
+static enum simd_isa requested_isa()
+{
+	const char* env = getenv("HIPERC_ISA");
+
+	if (env == NULL)
+		return ISA_AVX512;
+	else if (strcmp(env, "scalar") == 0)
+		return ISA_SCALAR;
+	else if (strcmp(env, "sse2") == 0)
+		return ISA_SSE2;
+	else if (strcmp(env, "avx2") == 0)
+		return ISA_AVX2;
+
+	return ISA_AVX512;
+}
+
+void simd_init()
+{
+	enum simd_isa isa = ISA_SCALAR;
+
+	#ifdef SIMD_X86
+	__builtin_cpu_init();
+	if (sizeof(fp_t) == sizeof(double)) {
+		if (__builtin_cpu_supports("avx512f"))
+			isa = ISA_AVX512;
+		else if (__builtin_cpu_supports("avx2"))
+			isa = ISA_AVX2;
+		else if (__builtin_cpu_supports("sse2"))
+			isa = ISA_SSE2;
+	}
+	#endif
+
+	if (requested_isa() < isa)
+		isa = requested_isa();
+
+	simd_level = isa;
+
+	switch(isa) {
+		#ifdef SIMD_X86
+		case ISA_AVX512:
+			simd_stencil = convolve_row_avx512;
+			simd_update = update_row_avx512;
+			simd_potential = potential_row_avx512;
+			break;
+		case ISA_AVX2:
+			simd_stencil = convolve_row_avx2;
+			simd_update = update_row_avx2;
+			simd_potential = potential_row_avx2;
+			break;
+		case ISA_SSE2:
+			simd_stencil = convolve_row_sse2;
+			simd_update = update_row_sse2;
+			simd_potential = potential_row_sse2;
+			break;
+		#endif
+		default:
+			simd_stencil = convolve_row;
+			simd_update = update_row_scalar;
+			simd_potential = potential_row_scalar;
+	}
+}
+
+const char* simd_isa_name()
+{
+	switch(simd_level) {
+		case ISA_AVX512:
+			return "avx512";
+		case ISA_AVX2:
+			return "avx2";
+		case ISA_SSE2:
+			return "sse2";
+		default:
+			return "scalar";
+	}
+}
+
+void simd_convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                       const int j, const int ilo, const int ihi, const int nm)
+{
+	simd_stencil(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+}
+
+void simd_potential_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                        const fp_t kappa, const int j, const int ilo, const int ihi, const int nm)
+{
+	simd_potential(conc, conc_row, mask_lap, kappa, j, ilo, ihi, nm);
+}
+
+void simd_update_row(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                     const int ilo, const int ihi, const fp_t alpha)
+{
+	simd_update(conc_old, conc_div, conc_new, ilo, ihi, alpha);
+}
+
+void simd_fence()
+{
+	#if defined(SIMD_X86) && defined(STREAM)
+	_mm_sfence();
+	#endif
+}
@@ -0,0 +1,81 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  simd.h
+ \brief Declaration of explicitly vectorized row kernels for spinodal decomposition benchmarks
+*/
+
+/** \cond SuppressGuard */
+#ifndef _SIMD_H_
+#define _SIMD_H_
+/** \endcond */
+
+#include "type.h"
+
+/**
+ \brief Instruction sets with hand-vectorized kernels, in order of preference
+*/
+enum simd_isa {
+	ISA_SCALAR = 0,
+	ISA_SSE2   = 1,
+	ISA_AVX2   = 2,
+	ISA_AVX512 = 3
+};
+
+/**
+ \brief Select the widest instruction set supported by the running CPU
+
+ Call once at startup, before any other function in this file. Setting the
+ environment variable \c HIPERC_ISA to \c scalar, \c sse2, \c avx2, or
+ \c avx512 caps the choice, which is handy for benchmarking one binary across
+ instruction sets. Vector kernels assume \c fp_t is \c double; otherwise, the
+ scalar path is always used.
+*/
+void simd_init();
+
+/**
+ \brief Name of the instruction set chosen by simd_init()
+*/
+const char* simd_isa_name();
+
+/**
+ \brief Convolve one row, vectorized across \a i
+
+ Arguments are the same as for convolve_row(). Each vector of results is
+ accumulated from unaligned loads of the neighboring columns, one load per
+ non-zero entry in the mask, in the same order as the scalar kernels, so
+ results are bit-identical to convolve_row().
+*/
+void simd_convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                       const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Chemical potential along one row, \f$ \mu = f'(c) - \kappa\nabla^2 c\f$
+
+ The vectorized counterpart of convolve_row() followed by dfdc(), as in
+ compute_laplacian(). Results are bit-identical to the scalar expressions.
+*/
+void simd_potential_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                        const fp_t kappa, const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Explicit Euler update of one row, \f$ c_{new} = c_{old} + \alpha\nabla^2\mu\f$
+
+ When compiled with \c STREAM defined, results are written with non-temporal
+ stores, which bypass the cache on the way to memory. Call simd_fence() before
+ another thread reads \a conc_new.
+*/
+void simd_update_row(const fp_t* conc_old, const fp_t* conc_div, fp_t* conc_new,
+                     const int ilo, const int ihi, const fp_t alpha);
+
+/**
+ \brief Make non-temporal stores from simd_update_row() globally visible
+*/
+void simd_fence();
+
+/** \cond SuppressGuard */
+#endif /* _SIMD_H_ */
+/** \endcond */
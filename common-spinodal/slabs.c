@@ -0,0 +1,81 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  slabs.c
+ \brief Implementation of row-slab decomposition and neighbor synchronization for threaded spinodal benchmarks
+*/
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include "slabs.h"
+
+/**
+ \brief Progress counter for one slab, alone on its cache line
+*/
+struct slab_flag {
+	long count;                     /**< last phase finished */
+	char pad[64 - sizeof(long)];    /**< keeps neighbors' counters off this line */
+};
+
+static struct slab_flag* flags = NULL;
+
+static int nslabs = 0;
+
+static int reach = 1;
+
+void slab_bounds(const int tid, const int nt, const int ny, const int nm, int* jlo, int* jhi)
+{
+	const int rows = ny - 2 * (nm/2);
+
+	*jlo = nm/2 + (tid * rows) / nt;
+	*jhi = nm/2 + ((tid + 1) * rows) / nt;
+}
+
+void slab_init(const int nt, const int ny, const int nm, const int halo)
+{
+	const int thinnest = (ny - 2 * (nm/2)) / nt;
+
+	/* every slab needs a row of its own */
+	assert(thinnest > 0);
+
+	nslabs = nt;
+	reach = (halo + thinnest - 1) / thinnest;
+	if (reach < 1)
+		reach = 1;
+
+	free(flags);
+	flags = (struct slab_flag*)aligned_alloc(64, nt * sizeof(struct slab_flag));
+	for (int n = 0; n < nt; n++)
+		flags[n].count = 0;
+}
+
+void slab_signal(const int tid, const long count)
+{
+	__atomic_store_n(&flags[tid].count, count, __ATOMIC_RELEASE);
+}
+
+void slab_wait(const int tid, const long count)
+{
+	const int lo = (tid - reach < 0) ? 0 : tid - reach;
+	const int hi = (tid + reach > nslabs - 1) ? nslabs - 1 : tid + reach;
+
+	for (int n = lo; n <= hi; n++) {
+		int spins = 0;
+		if (n == tid)
+			continue;
+		while (__atomic_load_n(&flags[n].count, __ATOMIC_ACQUIRE) < count)
+			if (++spins % 1024 == 0)
+				sched_yield();
+	}
+}
+
+void slab_free()
+{
+	free(flags);
+	flags = NULL;
+	nslabs = 0;
+}
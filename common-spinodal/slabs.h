@@ -0,0 +1,61 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  slabs.h
+ \brief Declaration of row-slab decomposition and neighbor synchronization for threaded spinodal benchmarks
+*/
+
+/** \cond SuppressGuard */
+#ifndef _SLABS_H_
+#define _SLABS_H_
+/** \endcond */
+
+/**
+ \brief Interior rows [\a jlo, \a jhi) owned by worker \a tid of \a nt
+
+ Slabs are contiguous and as even as possible, in thread order, so the
+ neighbors of slab \a tid are slabs \a tid-1 and \a tid+1.
+*/
+void slab_bounds(const int tid, const int nt, const int ny, const int nm, int* jlo, int* jhi);
+
+/**
+ \brief Set up progress counters for \a nt slabs, all starting from zero
+
+ \a halo is the number of rows beyond its own slab that a sweep reads. If the
+ thinnest slab is shallower than that, slab_wait() also watches the slabs two
+ or more places away, as far as the halo reaches. There must be at least
+ \a nt interior rows, so that no slab is empty. Call from one thread, and make
+ the others wait for it before they signal.
+*/
+void slab_init(const int nt, const int ny, const int nm, const int halo);
+
+/**
+ \brief Announce that slab \a tid has finished phase \a count
+
+ A release store: everything the thread wrote before the call is visible to a
+ thread whose slab_wait() returns for this \a count. Fence non-temporal
+ stores first.
+*/
+void slab_signal(const int tid, const long count);
+
+/**
+ \brief Wait until every slab within reach of \a tid has finished phase \a count
+
+ Spins on the neighbors' counters, yielding the CPU now and then so an
+ oversubscribed node still makes progress. Slabs out of reach are not waited
+ on, so one slow core holds back only its neighbors, and them only if it falls
+ a whole phase behind.
+*/
+void slab_wait(const int tid, const long count);
+
+/**
+ \brief Release the progress counters
+*/
+void slab_free();
+
+/** \cond SuppressGuard */
+#endif /* _SLABS_H_ */
+/** \endcond */
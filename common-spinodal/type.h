@@ -21,6 +21,15 @@
 */
 typedef double fp_t;
 
+/**
+ C++ has no \c restrict keyword, but GCC, Clang, and NVCC accept
+ \c __restrict__ to the same effect. Mesh rows are handed to kernels as
+ restrict-qualified pointers so the compiler may assume they do not alias.
+*/
+#ifdef __cplusplus
+#define restrict __restrict__
+#endif
+
 /**
  Container for timing data
 */
@@ -0,0 +1,190 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  writer.c
+ \brief Implementation of the background output writer for spinodal decomposition benchmarks
+*/
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "mesh.h"
+#include "output.h"
+#include "writer.h"
+
+/**
+ \brief One queued snapshot of the composition field
+*/
+struct Snapshot {
+	fp_t** conc;  /**< copy of the field, halo included */
+	int outputs;  /**< combination of #writer_output flags */
+	int step;     /**< timestep number */
+	fp_t elapsed; /**< simulation time */
+};
+
+/**
+ \brief Single-producer, single-consumer ring of snapshots
+
+ The stepping thread only advances \a head and the I/O thread only advances
+ \a tail, so neither index needs a lock. The semaphores count free and filled
+ slots; they exist to park a thread with nothing to do, not to guard the ring.
+*/
+static struct {
+	struct Snapshot* ring;
+	int depth;
+	unsigned head;
+	unsigned tail;
+	sem_t vacant;
+	sem_t filled;
+	pthread_t thread;
+	int running;
+	int threads;
+	int nx, ny, nm;
+	fp_t dx, dy, dt;
+} writer;
+
+static void write_snapshot(const struct Snapshot* snap)
+{
+	if (snap->outputs & WRITE_PNG)
+		write_png(snap->conc, writer.nx, writer.ny, writer.dt * snap->step);
+	if (snap->outputs & WRITE_CHECKPOINT)
+		write_checkpoint(snap->conc, writer.nx, writer.ny, writer.nm, writer.dx, writer.dy,
+		                 snap->step, snap->elapsed);
+	if (snap->outputs & WRITE_CSV)
+		write_csv(snap->conc, writer.nx, writer.ny, writer.dx, writer.dy, writer.dt * snap->step);
+}
+
+static void wait_for(sem_t* sem)
+{
+	while (sem_wait(sem) != 0 && errno == EINTR)
+		continue;
+}
+
+static void* drain_queue(void* arg)
+{
+	#ifdef _OPENMP
+	/* the PNG and CSV writers open parallel regions of their own, which would
+	   otherwise start a full team on the cores that are stepping */
+	omp_set_num_threads(writer.threads);
+	#endif
+
+	for (;;) {
+		wait_for(&writer.filled);
+
+		const unsigned tail = __atomic_load_n(&writer.tail, __ATOMIC_RELAXED);
+		struct Snapshot* snap = &writer.ring[tail % writer.depth];
+
+		/* an empty snapshot is the signal to stop */
+		if (snap->outputs == 0)
+			break;
+
+		write_snapshot(snap);
+
+		__atomic_store_n(&writer.tail, tail + 1, __ATOMIC_RELEASE);
+		sem_post(&writer.vacant);
+	}
+
+	return arg;
+}
+
+void start_writer(const int nx, const int ny, const int nm,
+                  const fp_t dx, const fp_t dy, const fp_t dt, const int depth)
+{
+	const char* env = getenv("HIPERC_WRITER");
+	const char* env_threads = getenv("HIPERC_WRITER_THREADS");
+
+	writer.nx = nx;
+	writer.ny = ny;
+	writer.nm = nm;
+	writer.dx = dx;
+	writer.dy = dy;
+	writer.dt = dt;
+	writer.depth = (depth > 0) ? depth : 1;
+	writer.head = 0;
+	writer.tail = 0;
+	writer.running = 0;
+	writer.threads = (env_threads != NULL) ? atoi(env_threads) : 1;
+	if (writer.threads < 1)
+		writer.threads = 1;
+
+	if (env != NULL && strcmp(env, "sync") == 0)
+		return;
+
+	writer.ring = (struct Snapshot*)calloc(writer.depth, sizeof(struct Snapshot));
+	for (int n = 0; n < writer.depth; n++)
+		writer.ring[n].conc = make_field(nx, ny, nm);
+
+	sem_init(&writer.vacant, 0, writer.depth);
+	sem_init(&writer.filled, 0, 0);
+
+	if (pthread_create(&writer.thread, NULL, drain_queue, NULL) != 0) {
+		printf("Warning: unable to start output thread. Writing synchronously.\n");
+		for (int n = 0; n < writer.depth; n++)
+			free_field(writer.ring[n].conc);
+		free(writer.ring);
+		sem_destroy(&writer.vacant);
+		sem_destroy(&writer.filled);
+		return;
+	}
+
+	writer.running = 1;
+}
+
+void queue_output(fp_t** conc, const int outputs, const int step, const fp_t elapsed)
+{
+	if (!writer.running) {
+		struct Snapshot snap = {conc, outputs, step, elapsed};
+		write_snapshot(&snap);
+		return;
+	}
+
+	/* back-pressure: wait here only if every snapshot is still queued */
+	wait_for(&writer.vacant);
+
+	const unsigned head = __atomic_load_n(&writer.head, __ATOMIC_RELAXED);
+	struct Snapshot* snap = &writer.ring[head % writer.depth];
+
+	for (int j = 0; j < writer.ny; j++)
+		memcpy(snap->conc[j], conc[j], writer.nx * sizeof(fp_t));
+	snap->outputs = outputs;
+	snap->step = step;
+	snap->elapsed = elapsed;
+
+	__atomic_store_n(&writer.head, head + 1, __ATOMIC_RELEASE);
+	sem_post(&writer.filled);
+}
+
+void stop_writer()
+{
+	if (!writer.running)
+		return;
+
+	/* queue an empty snapshot behind the others, then wait for the thread to reach it */
+	wait_for(&writer.vacant);
+	const unsigned head = __atomic_load_n(&writer.head, __ATOMIC_RELAXED);
+	writer.ring[head % writer.depth].outputs = 0;
+	__atomic_store_n(&writer.head, head + 1, __ATOMIC_RELEASE);
+	sem_post(&writer.filled);
+
+	pthread_join(writer.thread, NULL);
+
+	for (int n = 0; n < writer.depth; n++)
+		free_field(writer.ring[n].conc);
+	free(writer.ring);
+	sem_destroy(&writer.vacant);
+	sem_destroy(&writer.filled);
+	writer.running = 0;
+}
@@ -0,0 +1,63 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  writer.h
+ \brief Declaration of the background output writer for spinodal decomposition benchmarks
+*/
+
+/** \cond SuppressGuard */
+#ifndef _WRITER_H_
+#define _WRITER_H_
+/** \endcond */
+
+#include "type.h"
+
+/**
+ \brief Files to write from one snapshot, combined with bitwise OR
+*/
+enum writer_output {
+	WRITE_PNG        = 1, /**< write_png() */
+	WRITE_CSV        = 2, /**< write_csv() */
+	WRITE_CHECKPOINT = 4  /**< write_checkpoint() */
+};
+
+/**
+ \brief Default number of snapshot buffers in the output queue
+*/
+#define WRITER_DEPTH 2
+
+/**
+ \brief Start the background I/O thread
+
+ Allocates \a depth snapshot fields, each the size of the mesh, and a thread
+ to drain them. PNG and CSV files are named for the simulation time,
+ \a dt times the step. Setting the environment variable \c HIPERC_WRITER to \c sync,
+ or a failure to start the thread, makes queue_output() write synchronously
+ instead, which is handy for measuring what the overlap buys. OpenMP regions
+ opened by the I/O thread use \c HIPERC_WRITER_THREADS threads, 1 by default.
+*/
+void start_writer(const int nx, const int ny, const int nm,
+                  const fp_t dx, const fp_t dy, const fp_t dt, const int depth);
+
+/**
+ \brief Copy \a conc into a free snapshot and queue it for writing
+
+ Returns as soon as the copy is made; libpng and the filesystem are left to the
+ I/O thread. If every snapshot is still waiting to be written, blocks until one
+ is free, so a slow disk throttles the run rather than exhausting memory.
+ \a outputs is a combination of #writer_output flags, and \a step and
+ \a elapsed label the files.
+*/
+void queue_output(fp_t** conc, const int outputs, const int step, const fp_t elapsed);
+
+/**
+ \brief Write everything still queued, then stop the I/O thread and free its buffers
+*/
+void stop_writer();
+
+/** \cond SuppressGuard */
+#endif /* _WRITER_H_ */
+/** \endcond */
@@ -11,7 +11,7 @@
 class GridPtrData  {
 
 public:
-  GridPtrData(int x, int y, int nx, int nyx);
+  GridPtrData(int x, int y, int nx, int nyx, int step = 1);
 
   int getX() const;
 
@@ -21,11 +21,15 @@ public:
 
   int getNY() const;
 
+  // Timestep this block is advancing to
+  int getStep() const;
+
 private:
   int x;
   int y;
   int nx;
   int ny;
+  int step;
 
 };
 
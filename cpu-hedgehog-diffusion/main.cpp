@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
 #include <hedgehog/hedgehog.h>
 
 #include "data/GridPtrData.h"
+#include "state/TileState.h"
+#include "tasks/BoundaryTask.h"
 #include "tasks/DiffOpTask.h"
 #include "utils/type.h"
 #include "utils/output.h"
@@ -112,8 +117,19 @@ int main(int argc, char *argv[]) {
   param_parser(argc, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab,  &nm, &nx, &ny, &steps);
 
 
-  int nbx = nx / bx;
-  int nby = ny / by;
+  // threads for the block kernels: one per core, unless HIPERC_THREADS says otherwise
+  int nThreads = std::thread::hardware_concurrency();
+  if (std::getenv("HIPERC_THREADS") != NULL)
+    nThreads = std::atoi(std::getenv("HIPERC_THREADS"));
+  nThreads = std::max(1, nThreads);
+
+  // "bx 0" or "by 0" in the parameter file sizes the blocks for the cache
+  if (bx <= 0 || by <= 0)
+    choose_blocks(nx, ny, nm, nThreads, &bx, &by);
+
+  // blocks along the top and right edges take whatever is left of the mesh
+  int nbx = block_count(nx, bx, nm);
+  int nby = block_count(ny, by, nm);
 
   h = (dx > dy) ? dy : dx;
   dt = (linStab * h * h) / (4.0 * D);
@@ -143,10 +159,57 @@ int main(int argc, char *argv[]) {
 
   write_png(conc_old, nx, ny, 0);
 
+  uint64_t totTime2 = 0;
+
+#if defined(USE_HTGS) && !defined(STEP_BARRIER)
+  size_t nThreadsDiff = nThreads;
+  size_t nThreadsBoundary = 2;
+
+  // Blocks cycle through the graph on their own: each finished block goes to
+  // the state manager, which sends out whichever blocks it has made ready.
+  // There is no step-wide barrier until the run is over.
+  auto diffOpTask = std::make_shared<DiffOpTask>(nThreadsDiff, &conc_old, &conc_new, mask_lap, conc_lap, D, dt, nm, nbx, nby, nx, ny);
+  auto boundaryTask = std::make_shared<BoundaryTask>(nThreadsBoundary, &conc_old, &conc_new, nx, ny, nm, nbx, nby);
+  auto tileStateManager = std::make_shared<TileStateManager>(std::make_shared<TileState>(nbx, nby, bx, by, steps));
+
+  auto taskGraph = hh::Graph<GridPtrData, GridPtrData>();
+  taskGraph.input(diffOpTask);
+  taskGraph.addEdge(diffOpTask, boundaryTask);
+  taskGraph.addEdge(boundaryTask, tileStateManager);
+  taskGraph.addEdge(tileStateManager, diffOpTask);
+
+  taskGraph.executeGraph();
+
+  // the only boundary pass outside the graph sets up the initial condition
+  auto begin1 = std::chrono::high_resolution_clock::now();
+  apply_boundary_conditions(conc_old, nx, ny, nm);
+  auto end1 = std::chrono::high_resolution_clock::now();
+
+  totTime2 += std::chrono::duration_cast<std::chrono::microseconds>(end1 - begin1).count();
+
+  for (int i = 0; i < nby && steps > 0; i++)
+  {
+    for (int j = 0; j < nbx; j++)
+    {
+      // Start every block on the first step
+      taskGraph.pushData(std::make_shared<GridPtrData>(j, i, bx, by, 1));
+    }
+  }
+
+  taskGraph.finishPushingData();
+  taskGraph.waitForTermination();
+  taskGraph.createDotFile("post-exec.dot", hh::ColorScheme::EXECUTION);
+  taskGraph.createDotFile("post-exec-wait.dot", hh::ColorScheme::WAIT);
+
+  // odd steps write conc_new
+  if (steps % 2 == 1)
+    swap_pointers(&conc_old, &conc_new);
+  step = steps + 1;
+#else
 #ifdef USE_HTGS
-  size_t nThreadsDiff = 12;
+  size_t nThreadsDiff = nThreads;
 
-  auto diffOpTask = std::make_shared<DiffOpTask>(nThreadsDiff, &conc_old, &conc_new, mask_lap, conc_lap, D, dt, nm, nbx, nby);
+  auto diffOpTask = std::make_shared<DiffOpTask>(nThreadsDiff, &conc_old, &conc_new, mask_lap, conc_lap, D, dt, nm, nbx, nby, nx, ny);
 
   auto taskGraph = hh::Graph<GridPtrData, GridPtrData>();
   taskGraph.input(diffOpTask);
@@ -155,7 +218,6 @@ int main(int argc, char *argv[]) {
   taskGraph.executeGraph();
 ;
 #endif
-  uint64_t totTime2 = 0;
 
   for (step = 1; step < steps+1; step++)
   {
@@ -200,13 +262,16 @@ int main(int argc, char *argv[]) {
 
   }
 
-  write_png(conc_old, nx, ny, step);
-
 #ifdef USE_HTGS
   taskGraph.finishPushingData();
   taskGraph.waitForTermination();
-  taskGraph.createDotFile("post-exec.dot", hh::ColorScheme::EXECUTION);
+  taskGraph.createDotFile("post-exec-barrier.dot", hh::ColorScheme::EXECUTION);
+  taskGraph.createDotFile("post-exec-barrier-wait.dot", hh::ColorScheme::WAIT);
 #endif
+#endif
+
+  write_png(conc_old, nx, ny, step);
+
   auto end = std::chrono::high_resolution_clock::now();
 
   auto totTime = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
@@ -0,0 +1,53 @@
+//
+// Per-block step counts, releasing each block as soon as its neighbors allow
+//
+
+#include <algorithm>
+#include "TileState.h"
+
+TileState::TileState(int nbx, int nby, int bx, int by, int steps)
+    : nbx(nbx), nby(nby), bx(bx), by(by), steps(steps), finished(steps > 0 ? 0 : nbx * nby),
+      done(nbx * nby, 0), running(nbx * nby, true) {}
+
+void TileState::execute(std::shared_ptr<GridPtrData> data) {
+  int x = data->getX();
+  int y = data->getY();
+
+  done[y * nbx + x] = data->getStep();
+  running[y * nbx + x] = false;
+  if (data->getStep() == steps)
+    finished++;
+
+  // only this block and its neighbors can have become ready
+  for (int j = std::max(y - 1, 0); j <= std::min(y + 1, nby - 1); j++) {
+    for (int i = std::max(x - 1, 0); i <= std::min(x + 1, nbx - 1); i++) {
+      if (!running[j * nbx + i] && done[j * nbx + i] < steps && ready(i, j)) {
+        running[j * nbx + i] = true;
+        this->push(std::make_shared<GridPtrData>(i, j, bx, by, done[j * nbx + i] + 1));
+      }
+    }
+  }
+}
+
+bool TileState::ready(int x, int y) const {
+  for (int j = std::max(y - 1, 0); j <= std::min(y + 1, nby - 1); j++)
+    for (int i = std::max(x - 1, 0); i <= std::min(x + 1, nbx - 1); i++)
+      if (done[j * nbx + i] < done[y * nbx + x])
+        return false;
+
+  return true;
+}
+
+bool TileState::isDone() const {
+  return finished == nbx * nby;
+}
+
+TileStateManager::TileStateManager(std::shared_ptr<TileState> const &state)
+    : hh::StateManager<GridPtrData, GridPtrData>("TileStateManager", state) {}
+
+bool TileStateManager::canTerminate() {
+  this->state()->lock();
+  bool ret = std::dynamic_pointer_cast<TileState>(this->state())->isDone();
+  this->state()->unlock();
+  return ret;
+}
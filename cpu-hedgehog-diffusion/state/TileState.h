@@ -0,0 +1,53 @@
+//
+// Per-block step counts, releasing each block as soon as its neighbors allow
+//
+
+#ifndef HIPERC_HEDGEHOG_TILESTATE_H
+#define HIPERC_HEDGEHOG_TILESTATE_H
+
+
+#include <vector>
+#include <hedgehog/hedgehog.h>
+#include "../data/GridPtrData.h"
+
+// Receives each block as it finishes a step, and sends out every block whose
+// neighbors have now caught up with it. A block advancing to step t+1 reads
+// its eight neighbors at step t, and overwrites its own step t-1, which those
+// neighbors read on their way to step t. Both hold once no neighbor is behind
+// it, so neighboring blocks never drift more than one step apart, while blocks
+// farther away run ahead or behind freely.
+class TileState : public hh::AbstractState<GridPtrData, GridPtrData> {
+public:
+  TileState(int nbx, int nby, int bx, int by, int steps);
+
+  void execute(std::shared_ptr<GridPtrData> data) override;
+
+  // Every block has reached the last step
+  bool isDone() const;
+
+private:
+
+  int nbx, nby, bx, by, steps;
+
+  // blocks that have reached the last step
+  int finished;
+
+  // last step finished by each block, and whether it is out in the graph
+  std::vector<int> done;
+  std::vector<bool> running;
+
+  bool ready(int x, int y) const;
+
+};
+
+// Ends the cycle through DiffOpTask and BoundaryTask once every block is done
+class TileStateManager : public hh::StateManager<GridPtrData, GridPtrData> {
+public:
+  explicit TileStateManager(std::shared_ptr<TileState> const &state);
+
+  bool canTerminate() override;
+
+};
+
+
+#endif //HIPERC_HEDGEHOG_TILESTATE_H
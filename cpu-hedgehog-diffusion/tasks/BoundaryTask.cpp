@@ -0,0 +1,66 @@
+//
+// Boundary conditions for one block, inside the graph
+//
+
+#include <cstring>
+#include "BoundaryTask.h"
+#include "../utils/mesh.h"
+
+BoundaryTask::BoundaryTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, int nx, int ny, int nm, int nbx, int nby)
+    : hh::AbstractTask<GridPtrData, GridPtrData>("BoundaryTask", numThreads), conc_old(conc_old), conc_new(conc_new), nx(nx), ny(ny), nm(nm), nbx(nbx), nby(nby) {}
+
+void BoundaryTask::execute(std::shared_ptr<GridPtrData> data) {
+  int blockIdx = data->getX();
+  int blockIdy = data->getY();
+
+  bool left = (blockIdx == 0), right = (blockIdx == nbx-1);
+  bool bottom = (blockIdy == 0), top = (blockIdy == nby-1);
+
+  if (left || right || bottom || top) {
+    // same block extents as DiffOpTask
+    int ilo, ihi, jlo, jhi;
+    block_bounds(blockIdx, data->getNX(), nx, nm, &ilo, &ihi);
+    block_bounds(blockIdy, data->getNY(), ny, nm, &jlo, &jhi);
+
+    // ghost columns belong to the blocks along the left and right edges
+    int glo = left ? 0 : ilo;
+    int ghi = right ? nx : ihi;
+
+    fp_t **conc = (data->getStep() % 2 == 1) ? *conc_new : *conc_old;
+
+    for (int j = jlo; j < jhi; j++) {
+      fp_t *row = conc[j];
+
+      /* apply fixed boundary values */
+      if (j < ny/2 && left) {
+        for (int i = 0; i < 1+nm/2; i++)
+          row[i] = 1.0; /* left value */
+      } else if (j >= ny/2 && right) {
+        for (int i = nx-1-nm/2; i < nx; i++)
+          row[i] = 1.0; /* right value */
+      }
+
+      /* apply no-flux boundary conditions: ghost columns, then ghost rows */
+      for (int offset = 0; offset < nm/2; offset++) {
+        if (left)
+          row[offset] = row[nm/2];           /* left condition */
+        if (right)
+          row[nx-1-offset] = row[nx-1-nm/2]; /* right condition */
+      }
+
+      if (bottom && j == nm/2)
+        for (int k = 0; k < nm/2; k++)
+          memcpy(&conc[k][glo], &row[glo], (ghi - glo) * sizeof(fp_t)); /* bottom condition */
+
+      if (top && j == ny-1-nm/2)
+        for (int k = ny-nm/2; k < ny; k++)
+          memcpy(&conc[k][glo], &row[glo], (ghi - glo) * sizeof(fp_t)); /* top condition */
+    }
+  }
+
+  addResult(data);
+}
+
+std::shared_ptr<hh::AbstractTask<GridPtrData, GridPtrData>> BoundaryTask::copy() {
+  return std::make_shared<BoundaryTask>(this->numberThreads(), conc_old, conc_new, nx, ny, nm, nbx, nby);
+}
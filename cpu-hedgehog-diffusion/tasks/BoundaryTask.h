@@ -0,0 +1,33 @@
+//
+// Boundary conditions for one block, inside the graph
+//
+
+#ifndef HIPERC_HEDGEHOG_BOUNDARYTASK_H
+#define HIPERC_HEDGEHOG_BOUNDARYTASK_H
+
+
+#include <hedgehog/hedgehog.h>
+#include "../data/GridPtrData.h"
+#include "../utils/type.h"
+
+// Sets the fixed half-wall values and no-flux ghost cells that belong to a
+// block, on the field it was just written to. Blocks away from the edges of
+// the mesh pass straight through.
+class BoundaryTask : public hh::AbstractTask<GridPtrData, GridPtrData> {
+public:
+  BoundaryTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, int nx, int ny, int nm, int nbx, int nby);
+
+  void execute(std::shared_ptr<GridPtrData> data) override;
+
+  std::shared_ptr<hh::AbstractTask<GridPtrData, GridPtrData>> copy() override;
+
+private:
+
+  fp_t ***conc_old;
+  fp_t ***conc_new;
+  int nx, ny, nm, nbx, nby;
+
+};
+
+
+#endif //HIPERC_HEDGEHOG_BOUNDARYTASK_H
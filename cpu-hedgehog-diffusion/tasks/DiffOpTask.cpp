@@ -4,8 +4,8 @@
 
 #include "DiffOpTask.h"
 
-DiffOpTask::DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby)
-    : hh::AbstractTask<GridPtrData, GridPtrData>("DiffOpTask", numThreads), conc_old(conc_old), conc_new(conc_new), mask_lap(mask_lap), conc_lap(conc_lap), D(D), dt(dt), nm(nm), nbx(nbx), nby(nby) {}
+DiffOpTask::DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby, int nx, int ny)
+    : hh::AbstractTask<GridPtrData, GridPtrData>("DiffOpTask", numThreads), conc_old(conc_old), conc_new(conc_new), mask_lap(mask_lap), conc_lap(conc_lap), D(D), dt(dt), nm(nm), nbx(nbx), nby(nby), nx(nx), ny(ny) {}
 
 void DiffOpTask::execute(std::shared_ptr<GridPtrData> data) {
 
@@ -13,25 +13,26 @@ void DiffOpTask::execute(std::shared_ptr<GridPtrData> data) {
   int blockIdx = data->getX();
   int blockIdy = data->getY();
 
-  int ghostRegionSize = nm / 2;
+  // the last block in each direction takes whatever is left of the mesh
+  int i, j, nx, ny;
+  block_bounds(blockIdx, data->getNX(), this->nx, nm, &i, &nx);
+  block_bounds(blockIdy, data->getNY(), this->ny, nm, &j, &ny);
 
-  int nx = (data->getNX() * (blockIdx+1)) - (blockIdx == nbx-1 ? ghostRegionSize : 0) ;
-  int ny = (data->getNY() * (blockIdy+1)) - (blockIdy == nby-1 ? ghostRegionSize : 0);
-
-  int i = (blockIdx == 0 ? ghostRegionSize : 0) + (blockIdx * data->getNX());
-  int j = (blockIdy == 0 ? ghostRegionSize : 0) + (blockIdy * data->getNY());
 
+  // odd steps read conc_old and write conc_new, even steps the reverse
+  fp_t **src = (data->getStep() % 2 == 1) ? *conc_old : *conc_new;
+  fp_t **dst = (data->getStep() % 2 == 1) ? *conc_new : *conc_old;
 
   // i and j should be locations inside the boundary
   // nx and ny should be the width and height of the block
-  compute_convolution(*conc_old, conc_lap, mask_lap, i, j, nx, ny, nm);
+  compute_convolution(src, conc_lap, mask_lap, i, j, nx, ny, nm);
 
-  update_composition(*conc_old, conc_lap, *conc_new, i, j, nx, ny, nm, D, dt);
+  update_composition(src, conc_lap, dst, i, j, nx, ny, nm, D, dt);
   addResult(data);
 }
 
 std::shared_ptr<hh::AbstractTask<GridPtrData, GridPtrData>> DiffOpTask::copy() {
-  return std::make_shared<DiffOpTask>(this->numberThreads(), this->getConc_old(), this->getConc_new(), this->getMask_lap(), this->getConc_lap(), this->getD(), this->getDt(), this->getNm(), this->getNbx(), this->getNby());
+  return std::make_shared<DiffOpTask>(this->numberThreads(), this->getConc_old(), this->getConc_new(), this->getMask_lap(), this->getConc_lap(), this->getD(), this->getDt(), this->getNm(), this->getNbx(), this->getNby(), this->getNx(), this->getNy());
 }
 
 int DiffOpTask::getNbx() const {
@@ -42,6 +43,14 @@ int DiffOpTask::getNby() const {
   return nby;
 }
 
+int DiffOpTask::getNx() const {
+  return nx;
+}
+
+int DiffOpTask::getNy() const {
+  return ny;
+}
+
 fp_t **DiffOpTask::getMask_lap() const {
   return mask_lap;
 }
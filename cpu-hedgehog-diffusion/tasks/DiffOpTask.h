@@ -9,10 +9,12 @@
 #include <hedgehog/hedgehog.h>
 #include "../data/GridPtrData.h"
 #include "../utils/type.h"
+#include "../utils/mesh.h"
+#include "../utils/numerics.h"
 
 class DiffOpTask : public hh::AbstractTask<GridPtrData, GridPtrData> {
 public:
-  DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby);
+  DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby, int nx, int ny);
 
   void execute(std::shared_ptr<GridPtrData> data) override;
 
@@ -37,11 +39,18 @@ public:
 
   int getNby() const;
 
+  int getNx() const;
+
+  int getNy() const;
+
 
 private:
 
   int nm, nbx, nby;
 
+  // mesh size, ghost cells included
+  int nx, ny;
+
   fp_t **mask_lap;
   fp_t** conc_lap;
   fp_t ***conc_old;
@@ -54,15 +63,7 @@ private:
   {
 
     for (int j = startJ; j < ny; j++) {
-      for (int i = startI; i < nx; i++) {
-        fp_t value = 0.0;
-        for (int mj = -nm/2; mj < nm/2+1; mj++) {
-          for (int mi = -nm/2; mi < nm/2+1; mi++) {
-            value += mask_lap[mj+nm/2][mi+nm/2] * conc_old[j+mj][i+mi];
-          }
-        }
-        conc_lap[j][i] = value;
-      }
+      convolve_row(conc_old, conc_lap[j], mask_lap, j, startI, nx, nm);
     }
   }
 
@@ -22,8 +22,10 @@
  \brief Implemenatation of mesh handling functions for diffusion benchmarks
 */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include "mesh.h"
 
 void make_arrays(fp_t*** conc_old, fp_t*** conc_new, fp_t*** conc_lap, fp_t*** mask_lap,
@@ -32,9 +34,9 @@ void make_arrays(fp_t*** conc_old, fp_t*** conc_new, fp_t*** conc_lap, fp_t*** m
 	int i;
 
 	/* create 2D pointers */
-	*conc_old = (fp_t **)calloc(nx, sizeof(fp_t *));
-	*conc_new = (fp_t **)calloc(nx, sizeof(fp_t *));
-	*conc_lap = (fp_t **)calloc(nx, sizeof(fp_t *));
+	*conc_old = (fp_t **)calloc(ny, sizeof(fp_t *));
+	*conc_new = (fp_t **)calloc(ny, sizeof(fp_t *));
+	*conc_lap = (fp_t **)calloc(ny, sizeof(fp_t *));
 	*mask_lap = (fp_t **)calloc(nm, sizeof(fp_t *));
 
 	/* allocate 1D data */
@@ -87,3 +89,36 @@ void swap_pointers_1D(fp_t** conc_old, fp_t** conc_new)
 	(*conc_old) = (*conc_new);
 	(*conc_new) = temp;
 }
+
+int block_count(const int n, const int b, const int nm)
+{
+	return (n - nm/2 + b - 1) / b;
+}
+
+void block_bounds(const int k, const int b, const int n, const int nm, int* lo, int* hi)
+{
+	*lo = (k * b > nm/2) ? k * b : nm/2;
+	*hi = ((k+1) * b < n - nm/2) ? (k+1) * b : n - nm/2;
+}
+
+void choose_blocks(const int nx, const int ny, const int nm, const int threads, int* bx, int* by)
+{
+	long cache = -1;
+	int side;
+
+	#ifdef _SC_LEVEL2_CACHE_SIZE
+	cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	#endif
+	if (cache <= 0)
+		cache = 256 * 1024;
+
+	/* three fields per block, in half the cache, rounded to whole cache lines */
+	side = (int)sqrt(cache / (6.0 * sizeof(fp_t)));
+	side -= side % 8;
+
+	while (side > 8 && block_count(nx, side, nm) * block_count(ny, side, nm) < 4 * threads)
+		side = (side / 2) - (side / 2) % 8;
+
+	*bx = (side > 8) ? side : 8;
+	*by = *bx;
+}
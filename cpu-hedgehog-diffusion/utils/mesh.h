@@ -62,6 +62,28 @@ void swap_pointers(fp_t*** conc_old, fp_t*** conc_new);
 */
 void swap_pointers_1D(fp_t** conc_old, fp_t** conc_new);
 
+/**
+ \brief Number of blocks of width \a b needed to cover the interior of a mesh
+ \a n points wide
+
+ Blocks are laid out from the first ghost cell, so the last one may be
+ narrower than the rest, but never empty.
+*/
+int block_count(const int n, const int b, const int nm);
+
+/**
+ \brief Interior points [\a lo, \a hi) covered by block \a k of width \a b
+*/
+void block_bounds(const int k, const int b, const int n, const int nm, int* lo, int* hi);
+
+/**
+ \brief Choose square blocks for a mesh when the parameter file leaves them unset
+
+ The old, new, and Laplacian values of a block fill about half the L2 cache,
+ with the side halved until each of \a threads threads has a few blocks.
+*/
+void choose_blocks(const int nx, const int ny, const int nm, const int threads, int* bx, int* by);
+
 /** \cond SuppressGuard */
 #endif /* _MESH_H_ */
 /** \endcond */
@@ -54,6 +54,10 @@
 
  If your stencil is larger than \f$ 5\times 5\f$, you must increase the values
  defined by #MAX_MASK_W and #MAX_MASK_H.
+
+ This also selects the row kernel used by convolve_row(). For best performance,
+ write a kernel specialized for your mask and add it to the table searched by
+ select_stencil(); otherwise, convolve_row_generic() is used.
 */
 void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, const int nm);
 
@@ -83,6 +87,39 @@ void nine_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap,
 */
 void slow_nine_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap, const int nm);
 
+/**
+ \brief Convolve the mask with rows \a j-nm/2 through \a j+nm/2 of \a conc,
+ writing columns \a ilo through \a ihi-1 of \a conc_row
+
+ Kernels of this type are specialized for the footprint of a given mask: the
+ zero entries are skipped entirely, and the non-zero coefficients are read
+ once per row rather than once per point.
+*/
+typedef void (*stencil_row_t)(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                              const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Look up the row kernel specialized for the mask \a code
+
+ Codes with no specialized kernel, or a mask size \a nm that does not match
+ the code, get convolve_row_generic().
+*/
+stencil_row_t select_stencil(const int code, const int nm);
+
+/**
+ \brief Convolve one row using the kernel selected by the last call to set_mask()
+
+ This is the row-wise building block for compute_convolution().
+*/
+void convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                  const int j, const int ilo, const int ihi, const int nm);
+
+/**
+ \brief Convolve one row with an arbitrary \f$ nm\times nm\f$ mask
+*/
+void convolve_row_generic(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                          const int j, const int ilo, const int ihi, const int nm);
+
 /**
    \brief Perform the convolution of the mask matrix with the composition matrix
 
@@ -4,8 +4,8 @@
 
 #include "GridPtrData.h"
 
-GridPtrData::GridPtrData(int x, int y, int nx, int ny)
-    : x(x), y(y), nx(nx), ny(ny) {}
+GridPtrData::GridPtrData(int x, int y, int nx, int ny, int steps)
+    : x(x), y(y), nx(nx), ny(ny), steps(steps) {}
 
 int GridPtrData::getX() const {
   return x;
@@ -23,3 +23,6 @@ int GridPtrData::getNY() const {
   return ny;
 }
 
+int GridPtrData::getSteps() const {
+  return steps;
+}
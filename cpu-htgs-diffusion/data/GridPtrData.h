@@ -12,7 +12,7 @@
 class GridPtrData : public htgs::IData {
 
 public:
-  GridPtrData(int x, int y, int nx, int nyx);
+  GridPtrData(int x, int y, int nx, int nyx, int steps = 1);
 
   int getX() const;
 
@@ -22,11 +22,15 @@ public:
 
   int getNY() const;
 
+  // Timesteps to advance this block before handing it back
+  int getSteps() const;
+
 private:
   int x;
   int y;
   int nx;
   int ny;
+  int steps;
 
 };
 
@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
 #include <htgs/api/TaskGraphConf.hpp>
 #include <htgs/api/TaskGraphRuntime.hpp>
 #include "data/GridPtrData.h"
@@ -112,8 +115,19 @@ int main(int argc, char *argv[]) {
   param_parser(argc, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab,  &nm, &nx, &ny, &steps);
 
 
-  int nbx = nx / bx;
-  int nby = ny / by;
+  // threads for the block kernels: one per core, unless HIPERC_THREADS says otherwise
+  int nThreads = std::thread::hardware_concurrency();
+  if (std::getenv("HIPERC_THREADS") != NULL)
+    nThreads = std::atoi(std::getenv("HIPERC_THREADS"));
+  nThreads = std::max(1, nThreads);
+
+  // "bx 0" or "by 0" in the parameter file sizes the blocks for the cache
+  if (bx <= 0 || by <= 0)
+    choose_blocks(nx, ny, nm, nThreads, &bx, &by);
+
+  // blocks along the top and right edges take whatever is left of the mesh
+  int nbx = block_count(nx, bx, nm);
+  int nby = block_count(ny, by, nm);
 
   h = (dx > dy) ? dy : dx;
   dt = (linStab * h * h) / (4.0 * D);
@@ -143,10 +157,16 @@ int main(int argc, char *argv[]) {
 
   write_png(conc_old, nx, ny, 0);
 
+  // steps each block advances per pass, set by HIPERC_BLOCK_STEPS
+  int blockSteps = 1;
+
 #ifdef USE_HTGS
-  size_t nThreadsDiff = 12;
+  size_t nThreadsDiff = nThreads;
 
-  auto diffOpTask = new DiffOpTask(nThreadsDiff, &conc_old, &conc_new, mask_lap, conc_lap, D, dt, nm, nbx, nby);
+  if (std::getenv("HIPERC_BLOCK_STEPS") != NULL)
+    blockSteps = std::max(1, std::atoi(std::getenv("HIPERC_BLOCK_STEPS")));
+
+  auto diffOpTask = new DiffOpTask(nThreadsDiff, &conc_old, &conc_new, mask_lap, conc_lap, D, dt, nm, nbx, nby, nx, ny);
 
   auto taskGraph = new htgs::TaskGraphConf<GridPtrData, GridPtrData>();
 
@@ -159,8 +179,11 @@ int main(int argc, char *argv[]) {
 #endif
   uint64_t totTime2 = 0;
 
-  for (step = 1; step < steps+1; step++)
+  for (step = 1; step < steps+1; )
   {
+    // the last pass may be short
+    const int chunk = std::min(blockSteps, steps+1 - step);
+
     auto begin1 = std::chrono::high_resolution_clock::now();
     print_progress(step, steps);
 
@@ -180,7 +203,7 @@ int main(int argc, char *argv[]) {
       for (int j = 0; j < nbx; j++)
       {
         // Produce data block-by-block
-        taskGraph->produceData(new GridPtrData(j, i, bx, by));
+        taskGraph->produceData(new GridPtrData(j, i, bx, by, chunk));
 
       }
     }
@@ -195,6 +218,7 @@ int main(int argc, char *argv[]) {
 #endif
 
     swap_pointers(&conc_old, &conc_new);
+    step += chunk;
 
 //    if ((step % 100) == 0)
 //      write_png(conc_old, nx, ny, step);
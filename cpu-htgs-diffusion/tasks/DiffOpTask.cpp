@@ -2,10 +2,12 @@
 // Created by Timothy Blattner on 12/27/17.
 //
 
+#include <algorithm>
+#include <cstring>
 #include "DiffOpTask.h"
 
-DiffOpTask::DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby)
-    : ITask(numThreads), conc_old(conc_old), conc_new(conc_new), mask_lap(mask_lap), conc_lap(conc_lap), D(D), dt(dt), nm(nm), nbx(nbx), nby(nby) {}
+DiffOpTask::DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby, int nx, int ny)
+    : ITask(numThreads), conc_old(conc_old), conc_new(conc_new), mask_lap(mask_lap), conc_lap(conc_lap), D(D), dt(dt), nm(nm), nbx(nbx), nby(nby), nx(nx), ny(ny) {}
 
 void DiffOpTask::executeTask(std::shared_ptr<GridPtrData> data) {
 
@@ -13,25 +15,113 @@ void DiffOpTask::executeTask(std::shared_ptr<GridPtrData> data) {
   int blockIdx = data->getX();
   int blockIdy = data->getY();
 
-  int ghostRegionSize = nm / 2;
-
-  int nx = (data->getNX() * (blockIdx+1)) - (blockIdx == nbx-1 ? ghostRegionSize : 0) ;
-  int ny = (data->getNY() * (blockIdy+1)) - (blockIdy == nby-1 ? ghostRegionSize : 0);
-
-  int i = (blockIdx == 0 ? ghostRegionSize : 0) + (blockIdx * data->getNX());
-  int j = (blockIdy == 0 ? ghostRegionSize : 0) + (blockIdy * data->getNY());
+  // the last block in each direction takes whatever is left of the mesh
+  int i, j, nx, ny;
+  block_bounds(blockIdx, data->getNX(), this->nx, nm, &i, &nx);
+  block_bounds(blockIdy, data->getNY(), this->ny, nm, &j, &ny);
 
 
   // i and j should be locations inside the boundary
   // nx and ny should be the width and height of the block
-  compute_convolution(*conc_old, conc_lap, mask_lap, i, j, nx, ny, nm);
+  if (data->getSteps() > 1) {
+    advance_block(i, j, nx, ny, data->getSteps());
+  } else {
+    compute_convolution(*conc_old, conc_lap, mask_lap, i, j, nx, ny, nm);
 
-  update_composition(*conc_old, conc_lap, *conc_new, i, j, nx, ny, nm, D, dt);
+    update_composition(*conc_old, conc_lap, *conc_new, i, j, nx, ny, nm, D, dt);
+  }
   addResult(data);
 }
 
+// Advance the block [startI, endI) x [startJ, endJ) by several steps at once.
+// The block is copied out with a halo of steps*nm/2 cells, which shrinks by
+// nm/2 each step as its outer cells go stale, so only the block itself is
+// current at the end and goes back to conc_new. Where the halo meets the edge
+// of the mesh, boundary conditions are applied to the copy between steps,
+// exactly as apply_boundary_conditions() would, so every cell matches the
+// one-step-per-block result.
+void DiffOpTask::advance_block(int startI, int startJ, int endI, int endJ, int steps) {
+  const int r = nm / 2;
+  const int halo = steps * r;
+
+  const int i0 = std::max(startI - halo, 0);
+  const int i1 = std::min(endI + halo, nx);
+  const int j0 = std::max(startJ - halo, 0);
+  const int j1 = std::min(endJ + halo, ny);
+  const int w = i1 - i0;
+  const int h = j1 - j0;
+
+  if (tile_old.size() < (size_t)(w * h)) {
+    tile_old.resize(w * h);
+    tile_new.resize(w * h);
+  }
+  if (tile_lap.size() < (size_t)w)
+    tile_lap.resize(w);
+
+  rows_old.resize(h);
+  rows_new.resize(h);
+  for (int k = 0; k < h; k++) {
+    rows_old[k] = &tile_old[k * w];
+    rows_new[k] = &tile_new[k * w];
+  }
+
+  for (int j = j0; j < j1; j++)
+    memcpy(rows_old[j - j0], &(*conc_old)[j][i0], w * sizeof(fp_t));
+
+  for (int s = 0; s < steps; s++) {
+    // the block, plus as much halo as the remaining steps will read
+    const int reach = (steps - 1 - s) * r;
+    const int ilo = std::max(startI - reach, r);
+    const int ihi = std::min(endI + reach, nx - r);
+    const int jlo = std::max(startJ - reach, r);
+    const int jhi = std::min(endJ + reach, ny - r);
+
+    // conc_old arrives with its boundaries set
+    if (s > 0)
+      apply_block_boundaries(i0, i1, j0, j1);
+
+    for (int j = jlo; j < jhi; j++) {
+      convolve_row(rows_old.data(), tile_lap.data(), mask_lap, j - j0, ilo - i0, ihi - i0, nm);
+      for (int i = ilo - i0; i < ihi - i0; i++)
+        rows_new[j - j0][i] = rows_old[j - j0][i] + dt * D * tile_lap[i];
+    }
+
+    std::swap(rows_old, rows_new);
+  }
+
+  for (int j = startJ; j < endJ; j++)
+    memcpy(&(*conc_new)[j][startI], &rows_old[j - j0][startI - i0], (endI - startI) * sizeof(fp_t));
+}
+
+// Fixed values and no-flux ghost cells for the part of the mesh edge inside the
+// copy spanning [i0, i1) x [j0, j1): a ghost cell mirrors the nearest interior
+// cell, and the half-walls read 1.
+void DiffOpTask::apply_block_boundaries(int i0, int i1, int j0, int j1) {
+  const int r = nm / 2;
+
+  for (int j = j0; j < j1; j++) {
+    const int cj = std::min(std::max(j, r), ny - 1 - r);
+    const bool ghostRow = (cj != j);
+
+    for (int i = i0; i < i1; i++) {
+      // between the walls, only ghost rows have anything to set
+      if (!ghostRow && i > r && i < nx - 1 - r) {
+        i = nx - 2 - r;
+        continue;
+      }
+
+      const int ci = std::min(std::max(i, r), nx - 1 - r);
+
+      if ((cj < ny / 2 && ci == r) || (cj >= ny / 2 && ci == nx - 1 - r))
+        rows_old[j - j0][i - i0] = 1.0;
+      else if (ci != i || cj != j)
+        rows_old[j - j0][i - i0] = rows_old[cj - j0][ci - i0];
+    }
+  }
+}
+
 DiffOpTask *DiffOpTask::copy() {
-  return new DiffOpTask(this->getNumThreads(), this->getConc_old(), this->getConc_new(), this->getMask_lap(), this->getConc_lap(), this->getD(), this->getDt(), this->getNm(), this->getNbx(), this->getNby());
+  return new DiffOpTask(this->getNumThreads(), this->getConc_old(), this->getConc_new(), this->getMask_lap(), this->getConc_lap(), this->getD(), this->getDt(), this->getNm(), this->getNbx(), this->getNby(), this->getNx(), this->getNy());
 }
 
 int DiffOpTask::getNbx() const {
@@ -42,6 +132,14 @@ int DiffOpTask::getNby() const {
   return nby;
 }
 
+int DiffOpTask::getNx() const {
+  return nx;
+}
+
+int DiffOpTask::getNy() const {
+  return ny;
+}
+
 void DiffOpTask::initialize() {
 
 }
@@ -6,13 +6,16 @@
 #define HIPERC_HTGS_DIFFOPTASK_H
 
 
+#include <vector>
 #include <htgs/api/ITask.hpp>
 #include "../data/GridPtrData.h"
 #include "../utils/type.h"
+#include "../utils/mesh.h"
+#include "../utils/numerics.h"
 
 class DiffOpTask : public htgs::ITask<GridPtrData, GridPtrData> {
 public:
-  DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby);
+  DiffOpTask(size_t numThreads, fp_t ***conc_old, fp_t ***conc_new, fp_t **mask_lap, fp_t **conc_lap, fp_t D, fp_t dt, int nm, int nbx, int nby, int nx, int ny);
 
   void executeTask(std::shared_ptr<GridPtrData> data) override;
 
@@ -42,11 +45,18 @@ public:
 
   int getNby() const;
 
+  int getNx() const;
+
+  int getNy() const;
+
 
 private:
 
   int nm, nbx, nby;
 
+  // mesh size, ghost cells included
+  int nx, ny;
+
   fp_t **mask_lap;
   fp_t** conc_lap;
   fp_t ***conc_old;
@@ -54,20 +64,20 @@ private:
   fp_t D;
   fp_t dt;
 
+  // per-thread copy of one block and its halo, for multi-step blocks
+  std::vector<fp_t> tile_old, tile_new, tile_lap;
+  std::vector<fp_t *> rows_old, rows_new;
+
+  void advance_block(int startI, int startJ, int endI, int endJ, int steps);
+
+  void apply_block_boundaries(int i0, int i1, int j0, int j1);
+
   void compute_convolution(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
                            int startI, int startJ, const int nx, const int ny, const int nm)
   {
 
     for (int j = startJ; j < ny; j++) {
-      for (int i = startI; i < nx; i++) {
-        fp_t value = 0.0;
-        for (int mj = -nm/2; mj < nm/2+1; mj++) {
-          for (int mi = -nm/2; mi < nm/2+1; mi++) {
-            value += mask_lap[mj+nm/2][mi+nm/2] * conc_old[j+mj][i+mi];
-          }
-        }
-        conc_lap[j][i] = value;
-      }
+      convolve_row(conc_old, conc_lap[j], mask_lap, j, startI, nx, nm);
     }
   }
 
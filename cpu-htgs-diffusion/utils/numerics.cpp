@@ -28,6 +28,11 @@
 #include <stdlib.h>
 #include "numerics.h"
 
+/**
+ \brief Row kernel matching the mask most recently written by set_mask()
+*/
+static stencil_row_t active_stencil = convolve_row_generic;
+
 void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, const int nm)
 {
     switch(code) {
@@ -46,6 +51,8 @@ void set_mask(const fp_t dx, const fp_t dy, const int code, fp_t** mask_lap, con
 
 	assert(nm <= MAX_MASK_W);
 	assert(nm <= MAX_MASK_H);
+
+	active_stencil = select_stencil(code, nm);
 }
 
 void five_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask_lap, const int nm)
@@ -95,6 +102,110 @@ void slow_nine_point_Laplacian_stencil(const fp_t dx, const fp_t dy, fp_t** mask
 	mask_lap[4][2] = -1. / (12. * dy * dy); /* lower-lower-middle */
 }
 
+void convolve_row_generic(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                          const int j, const int ilo, const int ihi, const int nm)
+{
+	for (int i = ilo; i < ihi; i++) {
+		fp_t value = 0.0;
+		for (int mj = -nm/2; mj < nm/2+1; mj++) {
+			for (int mi = -nm/2; mi < nm/2+1; mi++) {
+				value += mask_lap[mj+nm/2][mi+nm/2] * conc[j+mj][i+mi];
+			}
+		}
+		conc_row[i] = value;
+	}
+}
+
+/**
+ \brief Row kernel for five_point_Laplacian_stencil()
+*/
+static void convolve_row_53(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                            const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t* up  = conc[j-1];
+	const fp_t* mid = conc[j];
+	const fp_t* dn  = conc[j+1];
+
+	const fp_t n = mask_lap[0][1];
+	const fp_t w = mask_lap[1][0], c = mask_lap[1][1], e = mask_lap[1][2];
+	const fp_t s = mask_lap[2][1];
+
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = n * up[i] + w * mid[i-1] + c * mid[i] + e * mid[i+1] + s * dn[i];
+}
+
+/**
+ \brief Row kernel for nine_point_Laplacian_stencil()
+*/
+static void convolve_row_93(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                            const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t* up  = conc[j-1];
+	const fp_t* mid = conc[j];
+	const fp_t* dn  = conc[j+1];
+
+	const fp_t nw = mask_lap[0][0], n = mask_lap[0][1], ne = mask_lap[0][2];
+	const fp_t w  = mask_lap[1][0], c = mask_lap[1][1], e  = mask_lap[1][2];
+	const fp_t sw = mask_lap[2][0], s = mask_lap[2][1], se = mask_lap[2][2];
+
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = nw * up[i-1]  + n * up[i]  + ne * up[i+1]
+		            + w  * mid[i-1] + c * mid[i] + e  * mid[i+1]
+		            + sw * dn[i-1]  + s * dn[i]  + se * dn[i+1];
+}
+
+/**
+ \brief Row kernel for slow_nine_point_Laplacian_stencil()
+*/
+static void convolve_row_95(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                            const int j, const int ilo, const int ihi, const int nm)
+{
+	const fp_t* uu  = conc[j-2];
+	const fp_t* up  = conc[j-1];
+	const fp_t* mid = conc[j];
+	const fp_t* dn  = conc[j+1];
+	const fp_t* dd  = conc[j+2];
+
+	const fp_t nn = mask_lap[0][2];
+	const fp_t n  = mask_lap[1][2];
+	const fp_t ww = mask_lap[2][0], w = mask_lap[2][1], c = mask_lap[2][2], e = mask_lap[2][3], ee = mask_lap[2][4];
+	const fp_t s  = mask_lap[3][2];
+	const fp_t ss = mask_lap[4][2];
+
+	for (int i = ilo; i < ihi; i++)
+		conc_row[i] = nn * uu[i] + n * up[i]
+		            + ww * mid[i-2] + w * mid[i-1] + c * mid[i] + e * mid[i+1] + ee * mid[i+2]
+		            + s * dn[i] + ss * dd[i];
+}
+
+/**
+ \brief Specialized row kernels, keyed on mask code and size
+*/
+static const struct {
+	int code;
+	int nm;
+	stencil_row_t kernel;
+} stencil_table[] = {
+	{53, 3, convolve_row_53},
+	{93, 3, convolve_row_93},
+	{95, 5, convolve_row_95}
+};
+
+stencil_row_t select_stencil(const int code, const int nm)
+{
+	for (size_t n = 0; n < sizeof(stencil_table) / sizeof(stencil_table[0]); n++)
+		if (stencil_table[n].code == code && stencil_table[n].nm == nm)
+			return stencil_table[n].kernel;
+
+	return convolve_row_generic;
+}
+
+void convolve_row(fp_t** const conc, fp_t* conc_row, fp_t** const mask_lap,
+                  const int j, const int ilo, const int ihi, const int nm)
+{
+	active_stencil(conc, conc_row, mask_lap, j, ilo, ihi, nm);
+}
+
 fp_t euclidean_distance(const fp_t ax, const fp_t ay,
 						const fp_t bx, const fp_t by)
 {
@@ -131,7 +242,7 @@ void check_solution(fp_t** conc_new, fp_t** conc_lap, const int nx, const int ny
 	fp_t sum = 0.;
 	int i, j;
 
-	#ifdef __OPENMP
+	#ifdef _OPENMP
 	#pragma omp parallel reduction(+:sum)
 	{
 		#pragma omp for collapse(2) private (i,j)
@@ -163,7 +274,7 @@ void check_solution(fp_t** conc_new, fp_t** conc_lap, const int nx, const int ny
 			}
 		}
 
-		#ifdef __OPENMP
+		#ifdef _OPENMP
 		#pragma omp for collapse(2) private(i,j)
 		#endif
 		for (j = nm/2; j < ny-nm/2; j++) {
@@ -171,7 +282,7 @@ void check_solution(fp_t** conc_new, fp_t** conc_lap, const int nx, const int ny
 				sum += conc_lap[j][i];
 			}
 		}
-	#ifdef __OPENMP
+	#ifdef _OPENMP
 	}
 	#endif
 
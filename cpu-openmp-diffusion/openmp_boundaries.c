@@ -10,6 +10,7 @@
 
 #include <math.h>
 #include <omp.h>
+#include <string.h>
 #include "boundaries.h"
 
 void apply_initial_conditions(fp_t** conc, const int nx, const int ny, const int nm)
@@ -33,46 +34,120 @@ void apply_initial_conditions(fp_t** conc, const int nx, const int ny, const int
 	}
 }
 
-void apply_boundary_conditions(fp_t** conc, const int nx, const int ny, const int nm)
+void apply_boundary_conditions_team(fp_t** conc, const int nx, const int ny, const int nm)
 {
-	#pragma omp parallel
-	{
-		/* apply fixed boundary values: sequence does not matter */
+	/* apply fixed boundary values: sequence does not matter */
 
-		#pragma omp for collapse(2)
-		for (int j = 0; j < ny/2; j++) {
-			for (int i = 0; i < 1+nm/2; i++) {
-				conc[j][i] = 1.; /* left value */
-			}
+	#pragma omp for collapse(2)
+	for (int j = 0; j < ny/2; j++) {
+		for (int i = 0; i < 1+nm/2; i++) {
+			conc[j][i] = 1.; /* left value */
 		}
+	}
 
-		#pragma omp for collapse(2)
-		for (int j = ny/2; j < ny; j++) {
-			for (int i = nx-1-nm/2; i < nx; i++) {
-				conc[j][i] = 1.; /* right value */
-			}
+	#pragma omp for collapse(2)
+	for (int j = ny/2; j < ny; j++) {
+		for (int i = nx-1-nm/2; i < nx; i++) {
+			conc[j][i] = 1.; /* right value */
 		}
+	}
 
-		/* apply no-flux boundary conditions: inside to out, sequence matters */
+	/* apply no-flux boundary conditions: inside to out, sequence matters */
 
-		for (int offset = 0; offset < nm/2; offset++) {
-			const int ilo = nm/2 - offset;
-			const int ihi = nx - 1 - nm/2 + offset;
-			#pragma omp for
-			for (int j = 0; j < ny; j++) {
-				conc[j][ilo-1] = conc[j][ilo]; /* left condition */
-				conc[j][ihi+1] = conc[j][ihi]; /* right condition */
-			}
+	for (int offset = 0; offset < nm/2; offset++) {
+		const int ilo = nm/2 - offset;
+		const int ihi = nx - 1 - nm/2 + offset;
+		#pragma omp for
+		for (int j = 0; j < ny; j++) {
+			conc[j][ilo-1] = conc[j][ilo]; /* left condition */
+			conc[j][ihi+1] = conc[j][ihi]; /* right condition */
+		}
+	}
+
+	for (int offset = 0; offset < nm/2; offset++) {
+		const int jlo = nm/2 - offset;
+		const int jhi = ny - 1 - nm/2 + offset;
+		#pragma omp for
+		for (int i = 0; i < nx; i++) {
+			conc[jlo-1][i] = conc[jlo][i]; /* bottom condition */
+			conc[jhi+1][i] = conc[jhi][i]; /* top condition */
 		}
+	}
+}
+
+void apply_boundary_conditions(fp_t** conc, const int nx, const int ny, const int nm)
+{
+	#pragma omp parallel
+	apply_boundary_conditions_team(conc, nx, ny, nm);
+}
+
+void apply_boundary_row(fp_t** conc, const int j, const int nx, const int ny, const int nm)
+{
+	fp_t* row = conc[j];
 
+	/* apply fixed boundary values */
+	if (j < ny/2) {
+		for (int i = 0; i < 1+nm/2; i++)
+			row[i] = 1.; /* left value */
+	} else {
+		for (int i = nx-1-nm/2; i < nx; i++)
+			row[i] = 1.; /* right value */
+	}
+
+	/* apply no-flux boundary conditions: ghost columns, then ghost rows */
+	for (int offset = 0; offset < nm/2; offset++) {
+		row[offset] = row[nm/2];             /* left condition */
+		row[nx-1-offset] = row[nx-1-nm/2];   /* right condition */
+	}
+
+	if (j == nm/2)
+		for (int k = 0; k < nm/2; k++)
+			memcpy(conc[k], row, nx * sizeof(fp_t)); /* bottom condition */
+
+	if (j == ny-1-nm/2)
+		for (int k = ny-nm/2; k < ny; k++)
+			memcpy(conc[k], row, nx * sizeof(fp_t)); /* top condition */
+}
+
+void apply_boundary_slab(fp_t** conc, const int jlo, const int jhi, const int nx, const int ny, const int nm)
+{
+	for (int j = jlo; j < jhi; j++)
+		apply_boundary_row(conc, j, nx, ny, nm);
+}
+
+void apply_boundary_tile(fp_t** conc, const int ilo, const int ihi, const int jlo, const int jhi,
+                         const int nx, const int ny, const int nm)
+{
+	/* ghost columns belong to the tiles along the left and right edges */
+	const int glo = (ilo == nm/2) ? 0 : ilo;
+	const int ghi = (ihi == nx-nm/2) ? nx : ihi;
+
+	for (int j = jlo; j < jhi; j++) {
+		fp_t* row = conc[j];
+
+		/* apply fixed boundary values */
+		if (j < ny/2 && ilo == nm/2) {
+			for (int i = 0; i < 1+nm/2; i++)
+				row[i] = 1.; /* left value */
+		} else if (j >= ny/2 && ihi == nx-nm/2) {
+			for (int i = nx-1-nm/2; i < nx; i++)
+				row[i] = 1.; /* right value */
+		}
+
+		/* apply no-flux boundary conditions: ghost columns, then ghost rows */
 		for (int offset = 0; offset < nm/2; offset++) {
-			const int jlo = nm/2 - offset;
-			const int jhi = ny - 1 - nm/2 + offset;
-			#pragma omp for
-			for (int i = 0; i < nx; i++) {
-				conc[jlo-1][i] = conc[jlo][i]; /* bottom condition */
-				conc[jhi+1][i] = conc[jhi][i]; /* top condition */
-			}
+			if (ilo == nm/2)
+				row[offset] = row[nm/2];             /* left condition */
+			if (ihi == nx-nm/2)
+				row[nx-1-offset] = row[nx-1-nm/2];   /* right condition */
 		}
+
+		if (j == nm/2)
+			for (int k = 0; k < nm/2; k++)
+				memcpy(&conc[k][glo], &row[glo], (ghi - glo) * sizeof(fp_t)); /* bottom condition */
+
+		if (j == ny-1-nm/2)
+			for (int k = ny-nm/2; k < ny; k++)
+				memcpy(&conc[k][glo], &row[glo], (ghi - glo) * sizeof(fp_t)); /* top condition */
 	}
 }
@@ -13,36 +13,196 @@
 #include "boundaries.h"
 #include "mesh.h"
 #include "numerics.h"
+#include "simd.h"
 #include "timer.h"
 
+void compute_convolution_team(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
+                              const int nx, const int ny, const int nm)
+{
+	#pragma omp for schedule(static) nowait
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		simd_convolve_row(conc_old, conc_lap[j], mask_lap, j, nm/2, nx-nm/2, nm);
+	}
+}
+
 void compute_convolution(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
                          const int nx, const int ny, const int nm)
 {
 	#pragma omp parallel
-	{
-		#pragma omp for collapse(2)
-		for (int j = nm/2; j < ny-nm/2; j++) {
-			for (int i = nm/2; i < nx-nm/2; i++) {
-				fp_t value = 0.0;
-				for (int mj = -nm/2; mj < nm/2+1; mj++) {
-					for (int mi = -nm/2; mi < nm/2+1; mi++) {
-						value += mask_lap[mj+nm/2][mi+nm/2] * conc_old[j+mj][i+mi];
-					}
-				}
-				conc_lap[j][i] = value;
-			}
-		}
+	compute_convolution_team(conc_old, conc_lap, mask_lap, nx, ny, nm);
+}
+
+void compute_convolution_slab(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
+                              const int jlo, const int jhi, const int nx, const int nm)
+{
+	for (int j = jlo; j < jhi; j++) {
+		simd_convolve_row(conc_old, conc_lap[j], mask_lap, j, nm/2, nx-nm/2, nm);
+	}
+}
+
+void update_composition_team(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
+                             const int nx, const int ny, const int nm,
+                             const fp_t D, const fp_t dt)
+{
+	#pragma omp for schedule(static) nowait
+	for (int j = nm/2; j < ny - nm/2; j++) {
+		simd_update_row(conc_old[j], conc_lap[j], conc_new[j], nm/2, nx-nm/2, dt * D);
+		#ifdef FUSED_BC
+		apply_boundary_row(conc_new, j, nx, ny, nm);
+		#endif
 	}
+
+	simd_fence();
 }
 
 void update_composition(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
 				   const int nx, const int ny, const int nm,
 				   const fp_t D, const fp_t dt)
 {
-	#pragma omp parallel for collapse(2)
-	for (int j = nm/2; j < ny - nm/2; j++) {
-		for (int i = nm/2; i < nx - nm/2; i++) {
-			conc_new[j][i] = conc_old[j][i] + dt * D * conc_lap[j][i];
+	#pragma omp parallel
+	update_composition_team(conc_old, conc_lap, conc_new, nx, ny, nm, D, dt);
+}
+
+void update_stage(fp_t** conc_old, fp_t** lap_old, fp_t** stage_1, fp_t** stage_2,
+                  fp_t** conc_lap, fp_t** stage, const int nx, const int ny, const int nm,
+                  const fp_t mu, const fp_t nu, const fp_t mu_dt, const fp_t gamma_dt)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		#pragma omp simd
+		for (int i = nm/2; i < nx-nm/2; i++) {
+			stage[j][i] = mu * stage_1[j][i] + nu * stage_2[j][i] + (1. - mu - nu) * conc_old[j][i]
+			            + mu_dt * conc_lap[j][i] + gamma_dt * lap_old[j][i];
+		}
+	}
+}
+
+void update_composition_slab(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
+                             const int jlo, const int jhi,
+                             const int nx, const int ny, const int nm,
+                             const fp_t D, const fp_t dt)
+{
+	for (int j = jlo; j < jhi; j++) {
+		simd_update_row(conc_old[j], conc_lap[j], conc_new[j], nm/2, nx-nm/2, dt * D);
+		#ifdef FUSED_BC
+		apply_boundary_row(conc_new, j, nx, ny, nm);
+		#endif
+	}
+
+	simd_fence();
+}
+
+void compute_step_tasks(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** mask_lap,
+                        char* tile_deps, const int step, const int depth,
+                        const int bx, const int by, const int nx, const int ny, const int nm,
+                        const fp_t D, const fp_t dt)
+{
+	const int tx = (nx - 2*(nm/2) + bx - 1) / bx;
+	const int ty = (ny - 2*(nm/2) + by - 1) / by;
+	const int slots = (depth > 2) ? depth : 2;
+
+	/* sentinels for the step being read, and for the step being written */
+	const int in = ((step - 1) % slots) * tx * ty;
+	const int out = (step % slots) * tx * ty;
+
+	/* Finish the step depth back, so at most that many steps are in flight.
+	   Its sentinels have not been reused, since there are at least depth
+	   sets. Letting the creating thread run far ahead scatters the tiles
+	   across the cache. */
+	if (depth > 0) {
+		const int done = (((step - depth) % slots + slots) % slots) * tx * ty;
+		#pragma omp taskwait depend(iterator(k = 0:tx*ty), in: tile_deps[done+k])
+	}
+
+	for (int n = 0; n < ty; n++) {
+		const int jlo = nm/2 + n * by;
+		const int jhi = (jlo + by < ny-nm/2) ? jlo + by : ny-nm/2;
+
+		/* neighbors clamped into the grid: repeated sentinels are harmless */
+		const int s = (n > 0) ? n-1 : n;
+		const int t = (n < ty-1) ? n+1 : n;
+
+		for (int m = 0; m < tx; m++) {
+			const int ilo = nm/2 + m * bx;
+			const int ihi = (ilo + bx < nx-nm/2) ? ilo + bx : nx-nm/2;
+
+			const int w = (m > 0) ? m-1 : m;
+			const int e = (m < tx-1) ? m+1 : m;
+
+			#pragma omp task firstprivate(ilo, ihi, jlo, jhi) \
+			                 depend(in: tile_deps[in+s*tx+w], tile_deps[in+s*tx+m], tile_deps[in+s*tx+e], \
+			                            tile_deps[in+n*tx+w], tile_deps[in+n*tx+m], tile_deps[in+n*tx+e], \
+			                            tile_deps[in+t*tx+w], tile_deps[in+t*tx+m], tile_deps[in+t*tx+e]) \
+			                 depend(out: tile_deps[out+n*tx+m])
+			{
+				for (int j = jlo; j < jhi; j++) {
+					simd_convolve_row(conc_old, conc_lap[j], mask_lap, j, ilo, ihi, nm);
+					simd_update_row(conc_old[j], conc_lap[j], conc_new[j], ilo, ihi, dt * D);
+				}
+				simd_fence();
+				apply_boundary_tile(conc_new, ilo, ihi, jlo, jhi, nx, ny, nm);
+			}
+		}
+	}
+}
+
+void cg_start(fp_t** conc_old, fp_t** conc_lap, fp_t** x, fp_t** r, fp_t** dinv, fp_t* rows,
+              const int nx, const int ny, const int nm, const fp_t a)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		fp_t sum = 0.;
+		#pragma omp simd reduction(+:sum)
+		for (int i = nm/2; i < nx-nm/2; i++) {
+			const fp_t unknown = (dinv[j][i] != 0.) ? 1. : 0.;
+			x[j][i] = unknown * conc_old[j][i];
+			r[j][i] = unknown * a * conc_lap[j][i];
+			sum += r[j][i] * dinv[j][i] * r[j][i];
+		}
+		rows[j] = sum;
+	}
+}
+
+void cg_apply(fp_t** p, fp_t** q, fp_t** mask_lap, fp_t* rows,
+              const int nx, const int ny, const int nm, const fp_t a)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		fp_t sum = 0.;
+		/* finish the row while its convolution is still in cache */
+		simd_convolve_row(p, q[j], mask_lap, j, nm/2, nx-nm/2, nm);
+		#pragma omp simd reduction(+:sum)
+		for (int i = nm/2; i < nx-nm/2; i++) {
+			q[j][i] = p[j][i] - a * q[j][i];
+			sum += p[j][i] * q[j][i];
 		}
+		rows[j] = sum;
+	}
+}
+
+void cg_update(fp_t** x, fp_t** r, fp_t** p, fp_t** q, fp_t** dinv, fp_t* rows,
+               const int nx, const int ny, const int nm, const fp_t alpha)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		fp_t sum = 0.;
+		#pragma omp simd reduction(+:sum)
+		for (int i = nm/2; i < nx-nm/2; i++) {
+			x[j][i] += alpha * p[j][i];
+			r[j][i] -= alpha * q[j][i];
+			sum += r[j][i] * dinv[j][i] * r[j][i];
+		}
+		rows[j] = sum;
+	}
+}
+
+void cg_direction(fp_t** p, fp_t** r, fp_t** dinv,
+                  const int nx, const int ny, const int nm, const fp_t beta)
+{
+	#pragma omp parallel for schedule(static)
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		#pragma omp simd
+		for (int i = nm/2; i < nx-nm/2; i++)
+			p[j][i] = dinv[j][i] * r[j][i] + beta * p[j][i];
 	}
 }
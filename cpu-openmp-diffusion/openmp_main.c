@@ -13,11 +13,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "affinity.h"
 #include "boundaries.h"
+#include "implicit.h"
 #include "mesh.h"
 #include "numerics.h"
 #include "output.h"
+#include "rkl.h"
+#include "simd.h"
+#include "slabs.h"
 #include "timer.h"
+#include "writer.h"
 
 /**
  \brief Run simulation using input parameters specified on the command line
@@ -32,51 +38,412 @@ int main(int argc, char* argv[])
 	fp_t dx=0.5, dy=0.5, h;
 
 	/* declare default materials and numerical parameters */
-	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0.;
+	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0., rss_err=0.;
 	int step=0, steps=100000, checks=10000;
 	double start_time=0.;
 	struct Stopwatch watch = {0., 0., 0., 0.};
 
 	StartTimer();
 
-	param_parser(argc, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab, &nm, &nx, &ny, &steps);
+	/* an optional second argument names a checkpoint to restart from */
+	const char* restart = (argc == 3) ? argv[2] : NULL;
+
+	param_parser((restart == NULL) ? argc : 2, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab, &nm, &nx, &ny, &steps);
 
 	h = (dx > dy) ? dy : dx;
 	dt = (linStab * h * h) / (4.0 * D);
 
+	/* pin threads before first touch, so pages land beside their threads */
+	affinity_init();
+	#pragma omp parallel
+	pin_thread(omp_get_thread_num());
+
 	/* initialize memory */
 	make_arrays(&conc_old, &conc_new, &conc_lap, &mask_lap, nx, ny, nm);
 	set_mask(dx, dy, code, mask_lap, nm);
+	start_writer(nx, ny, nm, dx, dy, WRITER_DEPTH);
+	simd_init();
 
 	print_progress(0, steps);
 
 	start_time = GetTimer();
 	apply_initial_conditions(conc_old, nx, ny, nm);
+	if (restart != NULL)
+		read_checkpoint(restart, conc_old, nx, ny, nm, dx, dy, &step, &elapsed);
+	const int start = step;
 	watch.step = GetTimer() - start_time;
 
 	/* write initial condition data */
 	start_time = GetTimer();
-	write_png(conc_old, nx, ny, 0);
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
 
-	/* prepare to log comparison to analytical solution */
-	output = fopen("runlog.csv", "w");
+	/* prepare to log comparison to analytical solution, continuing the old log on restart */
+	output = fopen("runlog.csv", (restart == NULL) ? "w" : "a");
 	if (output == NULL) {
 		printf("Error: unable to %s for output. Check permissions.\n", "runlog.csv");
 		exit(-1);
 	}
 	watch.file = GetTimer() - start_time;
 
-	fprintf(output, "iter,sim_time,wrss,conv_time,step_time,IO_time,soln_time,run_time\n");
-	fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
-			watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+	if (restart == NULL) {
+		fprintf(output, "iter,sim_time,wrss,conv_time,step_time,IO_time,soln_time,run_time\n");
+		fprintf(output, "# %s %s threads=%d\n", mesh_placement(), thread_placement(), omp_get_max_threads());
+		fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+				watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+	}
 	fflush(output);
 
+	#if defined(FUSED_BC) || defined(TASKS)
+	/* once here; afterwards, each sweep leaves its output's boundaries set */
+	apply_boundary_conditions(conc_old, nx, ny, nm);
+	#endif
+
+	#if defined(IMPLICIT)
+	/* each implicit step spans scale explicit steps, which must divide the checkpoint interval */
+	int scale = 10;
+	if (getenv("HIPERC_DT_SCALE") != NULL)
+		scale = atoi(getenv("HIPERC_DT_SCALE"));
+	if (scale < 1)
+		scale = 1;
+	while (checks % scale != 0)
+		scale--;
+
+	/* stop short of steps if the last stride would pass it */
+	steps = start + (steps - start) / scale * scale;
+	dt *= scale;
+
+	implicit_init(mask_lap, code, dx, dy, nx, ny, nm, D, dt, implicit_theta());
+	fprintf(output, "# implicit theta=%.1f dt=%f, %d explicit steps per step\n", implicit_theta(), dt, scale);
+	#elif defined(RKL2)
+	/* each super-step spans scale explicit steps, which must divide the checkpoint
+	   interval: as many as keep every mode accurate, unless told otherwise */
+	int scale = (getenv("HIPERC_DT_SCALE") != NULL) ? atoi(getenv("HIPERC_DT_SCALE"))
+	                                                : rkl_scale(mask_lap, nm, D, dt, checks);
+	if (scale < 1)
+		scale = 1;
+	while (checks % scale != 0)
+		scale--;
+
+	/* stop short of steps if the last stride would pass it */
+	steps = start + (steps - start) / scale * scale;
+	dt *= scale;
+
+	rkl_init(mask_lap, nx, ny, nm, D, dt);
+	fprintf(output, "# rkl2 dt=%f, %d stages, %d explicit steps per step\n", dt, rkl_stages(), scale);
+	#endif
+
 	/* do the work */
-	for (step = 1; step < steps+1; step++) {
+	const double loop_start = GetTimer();
+
+	#if defined(IMPLICIT)
+	/* Steps, checkpoints, and file names still count explicit steps, so the
+	   log lines up with the explicit builds'. */
+	long iters = 0;
+
+	for (step = start+scale; step < steps+1; step += scale) {
+		print_progress(step, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		apply_boundary_conditions(conc_old, nx, ny, nm);
+
+		start_time = GetTimer();
+		compute_convolution(conc_old, conc_lap, mask_lap, nx, ny, nm);
+		watch.conv += GetTimer() - start_time;
+
+		start_time = GetTimer();
+		iters += implicit_step(conc_old, conc_lap, conc_new, mask_lap, nx, ny, nm);
+		watch.step += GetTimer() - start_time;
+
+		swap_pointers(&conc_old, &conc_new);
+		elapsed += dt;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			start_time = GetTimer();
+			check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+			watch.soln += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
+			fprintf(output, "# cg iterations/step=%.1f\n", (double)(iters * scale) / checks);
+			fflush(output);
+			iters = 0;
+		}
+	}
+	implicit_free();
+	#elif defined(RKL2)
+	/* Steps, checkpoints, and file names still count explicit steps, so the
+	   log lines up with the explicit builds'. */
+	for (step = start+scale; step < steps+1; step += scale) {
+		print_progress(step, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		rkl_step(conc_old, conc_lap, conc_new, mask_lap, nx, ny, nm, &watch);
+
+		swap_pointers(&conc_old, &conc_new);
+		elapsed += dt;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			start_time = GetTimer();
+			check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+			watch.soln += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
+			fflush(output);
+		}
+	}
+	rkl_free();
+	#elif defined(TASKS)
+	/* One thread creates a task per tile per step, ordered only by the tiles
+	   each one reads, so several steps run at once. Before each step, it waits
+	   for the step HIPERC_TASK_LOOKAHEAD back (default 2, none if 0), and
+	   checkpoints wait for every task. */
+	int depth = 2;
+	if (getenv("HIPERC_TASK_LOOKAHEAD") != NULL)
+		depth = atoi(getenv("HIPERC_TASK_LOOKAHEAD"));
+	if (depth < 0)
+		depth = 0;
+	const int tiles = ((nx - 2*(nm/2) + bx - 1) / bx) * ((ny - 2*(nm/2) + by - 1) / by);
+	char* tile_deps = (char*)calloc(((depth > 2) ? depth : 2) * tiles, sizeof(char));
+	assert(bx >= nm/2 && by >= nm/2);
+
+	#pragma omp parallel
+	#pragma omp single
+	{
+		start_time = GetTimer();
+
+		for (step = start+1; step < steps+1; step++) {
+			print_progress(step, steps);
+
+			/* === Start Architecture-Specific Kernel === */
+			compute_step_tasks(conc_old, conc_lap, conc_new, mask_lap, tile_deps, step, depth,
+			                   bx, by, nx, ny, nm, D, dt);
+
+			swap_pointers(&conc_old, &conc_new);
+			elapsed += dt;
+			/* === Finish Architecture-Specific Kernel === */
+
+			if (step % checks == 0 || step == steps) {
+				/* steps overlap, so their time is only known in total */
+				#pragma omp taskwait
+				watch.step += GetTimer() - start_time;
+			}
+
+			if (step % checks == 0) {
+				start_time = GetTimer();
+				queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+				watch.file += GetTimer() - start_time;
+
+				start_time = GetTimer();
+				check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+				watch.soln += GetTimer() - start_time;
+
+				fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+						watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+				if (rss_err > 0.)
+					fprintf(output, "# wrss_err=%e\n", rss_err);
+				fflush(output);
+
+				start_time = GetTimer();
+			}
+		}
+	}
+	free(tile_deps);
+	#elif defined(SLAB_SYNC)
+	/* One team for the whole run, each thread owning a fixed slab of rows.
+	   Instead of barriers, a thread waits only for the slabs whose rows its
+	   stencil reaches to finish the same step. Checkpoints still stop everyone,
+	   and the whole team checks the solution. */
+	fp_t* sums = (fp_t*)malloc(2 * ny * sizeof(fp_t));
+
+	#pragma omp parallel private(step, start_time)
+	{
+		const int tid = omp_get_thread_num();
+		fp_t** field_old = conc_old;
+		fp_t** field_new = conc_new;
+		int jlo, jhi;
+
+		slab_bounds(tid, omp_get_num_threads(), ny, nm, &jlo, &jhi);
+
+		#pragma omp single
+		slab_init(omp_get_num_threads(), ny, nm, nm/2);
+
+		for (step = start+1; step < steps+1; step++) {
+			const long phase = step - start;
+
+			#pragma omp master
+			{
+				print_progress(step, steps);
+				start_time = GetTimer();
+			}
+
+			/* === Start Architecture-Specific Kernel === */
+			#ifndef FUSED_BC
+			apply_boundary_slab(field_old, jlo, jhi, nx, ny, nm);
+			#endif
+
+			slab_signal(tid, phase);
+			slab_wait(tid, phase);
+
+			compute_convolution_slab(field_old, conc_lap, mask_lap, jlo, jhi, nx, nm);
+
+			#pragma omp master
+			{
+				watch.conv += GetTimer() - start_time;
+				start_time = GetTimer();
+			}
+
+			update_composition_slab(field_old, conc_lap, field_new, jlo, jhi, nx, ny, nm, D, dt);
+
+			swap_pointers(&field_old, &field_new);
+			/* === Finish Architecture-Specific Kernel === */
+
+			#pragma omp master
+			{
+				watch.step += GetTimer() - start_time;
+				elapsed += dt;
+			}
+
+			if (step % checks == 0) {
+				/* every slab must be finished before the master reads the field */
+				#pragma omp barrier
+
+				#pragma omp master
+				{
+					start_time = GetTimer();
+					queue_output(field_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+					watch.file += GetTimer() - start_time;
+
+					start_time = GetTimer();
+				}
+
+				/* ends with a barrier, so no slab moves on before the writer has
+				   copied the field */
+				check_solution_team(field_old, nx, ny, dx, dy, nm, elapsed, D, sums, &rss, &rss_err);
+
+				#pragma omp master
+				{
+					watch.soln += GetTimer() - start_time;
+
+					fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+							watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+					if (rss_err > 0.)
+						fprintf(output, "# wrss_err=%e\n", rss_err);
+					fflush(output);
+				}
+			}
+		}
+
+		#pragma omp master
+		{
+			conc_old = field_old;
+			conc_new = field_new;
+		}
+	}
+	slab_free();
+	free(sums);
+	#elif defined(PERSISTENT)
+	/* One team for the whole run. Each thread swaps its own copies of the
+	   field pointers; the master alone times, logs, and writes checkpoints,
+	   but the whole team checks the solution. */
+	fp_t* sums = (fp_t*)malloc(2 * ny * sizeof(fp_t));
+
+	#pragma omp parallel private(step, start_time)
+	{
+		fp_t** field_old = conc_old;
+		fp_t** field_new = conc_new;
+
+		for (step = start+1; step < steps+1; step++) {
+			#pragma omp master
+			{
+				print_progress(step, steps);
+				start_time = GetTimer();
+			}
+
+			/* === Start Architecture-Specific Kernel === */
+			#ifndef FUSED_BC
+			apply_boundary_conditions_team(field_old, nx, ny, nm);
+			#endif
+
+			/* no barrier: each thread updates the rows it convolved */
+			compute_convolution_team(field_old, conc_lap, mask_lap, nx, ny, nm);
+
+			#pragma omp master
+			{
+				watch.conv += GetTimer() - start_time;
+				start_time = GetTimer();
+			}
+
+			update_composition_team(field_old, conc_lap, field_new, nx, ny, nm, D, dt);
+			#pragma omp barrier
+
+			swap_pointers(&field_old, &field_new);
+			/* === Finish Architecture-Specific Kernel === */
+
+			#pragma omp master
+			{
+				watch.step += GetTimer() - start_time;
+				elapsed += dt;
+			}
+
+			if (step % checks == 0) {
+				#pragma omp master
+				{
+					start_time = GetTimer();
+					queue_output(field_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+					watch.file += GetTimer() - start_time;
+
+					start_time = GetTimer();
+				}
+				/* the team reads the elapsed time the master just advanced */
+				#pragma omp barrier
+
+				/* ends with a barrier, so the next step cannot overwrite the field
+				   before the writer has copied it */
+				check_solution_team(field_old, nx, ny, dx, dy, nm, elapsed, D, sums, &rss, &rss_err);
+
+				#pragma omp master
+				{
+					watch.soln += GetTimer() - start_time;
+
+					fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+							watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+					if (rss_err > 0.)
+						fprintf(output, "# wrss_err=%e\n", rss_err);
+					fflush(output);
+				}
+			}
+		}
+
+		#pragma omp master
+		{
+			conc_old = field_old;
+			conc_new = field_new;
+		}
+	}
+	free(sums);
+	#else
+	for (step = start+1; step < steps+1; step++) {
 		print_progress(step, steps);
 
 		/* === Start Architecture-Specific Kernel === */
+		#ifndef FUSED_BC
 		apply_boundary_conditions(conc_old, nx, ny, nm);
+		#endif
 
 		start_time = GetTimer();
 		compute_convolution(conc_old, conc_lap, mask_lap, nx, ny, nm);
@@ -92,22 +459,31 @@ int main(int argc, char* argv[])
 
 		if (step % checks == 0) {
 			start_time = GetTimer();
-			write_png(conc_old, nx, ny, step);
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
 			watch.file += GetTimer() - start_time;
 
 			start_time = GetTimer();
-			check_solution(conc_old, conc_lap, nx, ny, dx, dy, nm, elapsed, D, &rss);
+			check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
 			watch.soln += GetTimer() - start_time;
 
 			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
 					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
 			fflush(output);
 		}
 	}
 
-	write_csv(conc_old, nx, ny, dx, dy, steps);
+	#endif
+
+	if (steps > start)
+		fprintf(output, "# %d steps, %.3f us/step\n", steps - start,
+		        1.0e6 * (GetTimer() - loop_start) / (steps - start));
+
+	queue_output(conc_old, WRITE_CSV, steps, elapsed);
 
 	/* clean up */
+	stop_writer();
 	fclose(output);
 	free_arrays(conc_old, conc_new, conc_lap, mask_lap);
 
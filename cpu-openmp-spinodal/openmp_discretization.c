@@ -13,6 +13,8 @@
 #include "boundaries.h"
 #include "mesh.h"
 #include "numerics.h"
+#include "simd.h"
+#include "slabs.h"
 #include "timer.h"
 
 fp_t dfdc(const fp_t C)
@@ -27,49 +29,158 @@ fp_t dfdc(const fp_t C)
 	return 2.0 * rho * A * B * (Ca + Cb - 2.0 * C);
 }
 
+void compute_laplacian_team(fp_t** conc_old, fp_t** conc_lap,
+                            fp_t** mask_lap, const fp_t kappa,
+                            const int nx, const int ny, const int nm)
+{
+	#pragma omp for
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		simd_potential_row(conc_old, conc_lap[j], mask_lap, kappa, j, nm/2, nx-nm/2, nm);
+		#ifdef FUSED_BC
+		apply_boundary_row(conc_lap, j, nx, ny, nm);
+		#endif
+	}
+}
+
 void compute_laplacian(fp_t** conc_old, fp_t** conc_lap,
 					   fp_t** mask_lap, const fp_t kappa,
 					   const int nx, const int ny, const int nm)
 {
-	#pragma omp parallel for collapse(2)
+	#pragma omp parallel
+	compute_laplacian_team(conc_old, conc_lap, mask_lap, kappa, nx, ny, nm);
+}
+
+void compute_laplacian_slab(fp_t** conc_old, fp_t** conc_lap,
+                            fp_t** mask_lap, const fp_t kappa,
+                            const int jlo, const int jhi,
+                            const int nx, const int ny, const int nm)
+{
+	for (int j = jlo; j < jhi; j++) {
+		simd_potential_row(conc_old, conc_lap[j], mask_lap, kappa, j, nm/2, nx-nm/2, nm);
+		apply_boundary_row(conc_lap, j, nx, ny, nm);
+	}
+}
+
+void compute_divergence_team(fp_t** conc_lap, fp_t** conc_div, fp_t** mask_lap,
+                             const int nx, const int ny, const int nm)
+{
+	#pragma omp for schedule(static) nowait
 	for (int j = nm/2; j < ny-nm/2; j++) {
-		for (int i = nm/2; i < nx-nm/2; i++) {
-			fp_t value = 0.0;
-			for (int mj = -nm/2; mj < nm/2+1; mj++) {
-				for (int mi = -nm/2; mi < nm/2+1; mi++) {
-					value += mask_lap[mj+nm/2][mi+nm/2] * conc_old[j+mj][i+mi];
-				}
-			}
-			conc_lap[j][i] = dfdc(conc_old[j][i]) - kappa * value;
-		}
+		simd_convolve_row(conc_lap, conc_div[j], mask_lap, j, nm/2, nx-nm/2, nm);
 	}
 }
 
 void compute_divergence(fp_t** conc_lap, fp_t** conc_div, fp_t** mask_lap,
                          const int nx, const int ny, const int nm)
 {
-	#pragma omp parallel for collapse(2)
-	for (int j = nm/2; j < ny-nm/2; j++) {
-		for (int i = nm/2; i < nx-nm/2; i++) {
-			fp_t value = 0.0;
-			for (int mj = -nm/2; mj < nm/2+1; mj++) {
-				for (int mi = -nm/2; mi < nm/2+1; mi++) {
-					value += mask_lap[mj+nm/2][mi+nm/2] * conc_lap[j+mj][i+mi];
-				}
-			}
-			conc_div[j][i] = value;
-		}
+	#pragma omp parallel
+	compute_divergence_team(conc_lap, conc_div, mask_lap, nx, ny, nm);
+}
+
+void compute_divergence_slab(fp_t** conc_lap, fp_t** conc_div, fp_t** mask_lap,
+                             const int jlo, const int jhi, const int nx, const int nm)
+{
+	for (int j = jlo; j < jhi; j++) {
+		simd_convolve_row(conc_lap, conc_div[j], mask_lap, j, nm/2, nx-nm/2, nm);
+	}
+}
+
+void update_composition_team(fp_t** conc_old, fp_t** conc_div, fp_t** conc_new,
+                             const int nx, const int ny, const int nm,
+                             const fp_t M, const fp_t dt)
+{
+	#pragma omp for schedule(static) nowait
+	for (int j = nm/2; j < ny - nm/2; j++) {
+		simd_update_row(conc_old[j], conc_div[j], conc_new[j], nm/2, nx-nm/2, dt * M);
+		#ifdef FUSED_BC
+		apply_boundary_row(conc_new, j, nx, ny, nm);
+		#endif
 	}
+
+	simd_fence();
 }
 
 void update_composition(fp_t** conc_old, fp_t** conc_div, fp_t** conc_new,
 						const int nx, const int ny, const int nm,
 						const fp_t M, const fp_t dt)
 {
-	#pragma omp parallel for collapse(2)
-	for (int j = nm/2; j < ny - nm/2; j++) {
-		for (int i = nm/2; i < nx - nm/2; i++) {
-			conc_new[j][i] = conc_old[j][i] + dt * M * conc_div[j][i];
-		}
+	#pragma omp parallel
+	update_composition_team(conc_old, conc_div, conc_new, nx, ny, nm, M, dt);
+}
+
+void update_composition_slab(fp_t** conc_old, fp_t** conc_div, fp_t** conc_new,
+                             const int jlo, const int jhi,
+                             const int nx, const int ny, const int nm,
+                             const fp_t M, const fp_t dt)
+{
+	for (int j = jlo; j < jhi; j++) {
+		simd_update_row(conc_old[j], conc_div[j], conc_new[j], nm/2, nx-nm/2, dt * M);
+		#ifdef FUSED_BC
+		apply_boundary_row(conc_new, j, nx, ny, nm);
+		#endif
+	}
+
+	simd_fence();
+}
+
+/**
+ \brief Compute chemical potential along row \a k into \a row, mirrored across
+ the boundaries by clamping indices into the interior
+*/
+static void fused_potential_row(fp_t** conc_old, fp_t* row, fp_t** mask_lap,
+                                const fp_t kappa, const int k,
+                                const int nx, const int ny, const int nm)
+{
+	const int j = (k < nm/2) ? nm/2 : (k > ny-1-nm/2) ? ny-1-nm/2 : k;
+
+	simd_potential_row(conc_old, row, mask_lap, kappa, j, nm/2, nx-nm/2, nm);
+
+	for (int i = 0; i < nm/2; i++) {
+		row[i] = row[nm/2];
+		row[nx-1-i] = row[nx-1-nm/2];
+	}
+}
+
+void compute_fused_step_team(fp_t** conc_old, fp_t* conc_win, fp_t** conc_new,
+                             fp_t** mask_lap, const fp_t kappa,
+                             const int nx, const int ny, const int nm,
+                             const fp_t M, const fp_t dt)
+{
+	int jlo, jhi;
+
+	/* static slab of interior rows owned by this thread */
+	const int tid = omp_get_thread_num();
+	slab_bounds(tid, omp_get_num_threads(), ny, nm, &jlo, &jhi);
+
+	fp_t* window = &conc_win[tid * nm * nx];
+	fp_t* mu[MAX_MASK_H];
+
+	/* prime the window with all but the leading row */
+	for (int k = jlo - nm/2; k < jlo + nm/2 && jlo < jhi; k++)
+		fused_potential_row(conc_old, &window[(k % nm) * nx], mask_lap, kappa, k, nx, ny, nm);
+
+	for (int j = jlo; j < jhi; j++) {
+		fused_potential_row(conc_old, &window[((j + nm/2) % nm) * nx], mask_lap, kappa, j + nm/2, nx, ny, nm);
+
+		for (int mj = -nm/2; mj < nm/2+1; mj++)
+			mu[mj+nm/2] = &window[((j + mj) % nm) * nx];
+
+		/* divergence of the potential, written into conc_new and updated in place */
+		simd_convolve_row(mu, conc_new[j], mask_lap, nm/2, nm/2, nx-nm/2, nm);
+		simd_update_row(conc_old[j], conc_new[j], conc_new[j], nm/2, nx-nm/2, dt * M);
+		#ifdef FUSED_BC
+		apply_boundary_row(conc_new, j, nx, ny, nm);
+		#endif
 	}
+
+	simd_fence();
+}
+
+void compute_fused_step(fp_t** conc_old, fp_t* conc_win, fp_t** conc_new,
+                        fp_t** mask_lap, const fp_t kappa,
+                        const int nx, const int ny, const int nm,
+                        const fp_t M, const fp_t dt)
+{
+	#pragma omp parallel
+	compute_fused_step_team(conc_old, conc_win, conc_new, mask_lap, kappa, nx, ny, nm, M, dt);
 }
@@ -13,11 +13,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "adaptive.h"
 #include "boundaries.h"
 #include "mesh.h"
 #include "numerics.h"
 #include "output.h"
+#include "simd.h"
+#include "slabs.h"
 #include "timer.h"
+#include "writer.h"
 
 /**
  \brief Run simulation using input parameters specified on the command line
@@ -27,7 +31,7 @@ int main(int argc, char* argv[])
 	FILE * output;
 
 	/* declare default mesh size and resolution */
-	fp_t **conc_old, **conc_new, **conc_lap, **conc_div, **mask_lap;
+	fp_t **conc_old, **conc_new, **conc_lap = NULL, **conc_div = NULL, **mask_lap;
 	int bx=32, by=32, nx=202, ny=202, nm=3, code=53;
 	const fp_t dx=1.0, dy=1.0;
 
@@ -38,13 +42,27 @@ int main(int argc, char* argv[])
 
 	StartTimer();
 
-	param_parser(argc, argv, &bx, &by, &checks, &code, &M, &kappa, &linStab, &nm, &nx, &ny, &steps);
+	/* an optional second argument names a checkpoint to restart from */
+	const char* restart = (argc == 3) ? argv[2] : NULL;
+
+	param_parser((restart == NULL) ? argc : 2, argv, &bx, &by, &checks, &code, &M, &kappa, &linStab, &nm, &nx, &ny, &steps);
 
 	const fp_t dt = linStab / (24.0 * M * kappa);
 
-	/* initialize memory */
+	/* initialize memory; the fused sweep needs no Laplacian or divergence fields */
+	#ifdef FUSED
+	make_arrays(&conc_old, &conc_new, NULL, NULL, &mask_lap, nx, ny, nm);
+	#else
 	make_arrays(&conc_old, &conc_new, &conc_lap, &conc_div, &mask_lap, nx, ny, nm);
+	#endif
 	set_mask(dx, dy, code, mask_lap, nm);
+	start_writer(nx, ny, nm, dx, dy, dt, WRITER_DEPTH);
+	simd_init();
+
+	#ifdef FUSED
+	/* rolling window of chemical potential rows for each thread */
+	fp_t* conc_win = (fp_t*)calloc(omp_get_max_threads() * nm * nx, sizeof(fp_t));
+	#endif
 
 	print_progress(step, steps);
 
@@ -54,33 +72,333 @@ int main(int argc, char* argv[])
 
 	/* write initial condition data */
 	start_time = GetTimer();
-	write_png(conc_old, nx, ny, 0);
+	if (restart != NULL)
+		read_checkpoint(restart, conc_old, nx, ny, nm, dx, dy, &step, &elapsed);
+	const int start = step;
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
 
-	/* prepare to log comparison to analytical solution */
-	output = fopen("runlog.csv", "w");
+	/* prepare to log comparison to analytical solution, continuing the old log on restart */
+	output = fopen("runlog.csv", (restart == NULL) ? "w" : "a");
 	if (output == NULL) {
 		printf("Error: unable to %s for output. Check permissions.\n", "runlog.csv");
 		exit(-1);
 	}
 	watch.file = GetTimer() - start_time;
 
-	fprintf(output, "iter,sim_time,energy,conv_time,step_time,IO_time,run_time\n");
-	fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, nx*dx * ny*dy * chem_energy(0.5),
+	if (restart == NULL) {
+		fprintf(output, "iter,sim_time,energy,conv_time,step_time,IO_time,run_time\n");
+		energy = nx*dx * ny*dy * chem_energy(0.5);
+	} else {
+		free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy);
+	}
+	fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
 			watch.conv, watch.step, watch.file, GetTimer());
 	fflush(output);
 
+	#ifdef FUSED_BC
+	/* once here; afterwards, each sweep leaves its output's boundaries set */
+	apply_boundary_conditions(conc_old, nx, ny, nm);
+	#endif
+
 	/* do the work */
-	for (step = 1; step < steps+1; step++) {
+	const double loop_start = GetTimer();
+
+	#if defined(ADAPTIVE)
+	/* Steps of any length up to the stability limit, checked in stretches and
+	   kept only if the free energy does not rise. Checkpoints still come every
+	   checks steps of dt, and step numbers count those, so sim_time matches
+	   the other builds. */
+	const fp_t dt_max = explicit_dt_limit(mask_lap, nm, M, kappa);
+	adapt_init(dt, dt_max, 10, nx, ny, nm);
+	if (restart != NULL && !adapt_resume("runlog.csv", start))
+		printf("Warning: no adaptive step logged for step %i. Starting over from %e.\n", start, dt);
+	fprintf(output, "# adaptive dt_max=%e, %.2f explicit steps\n", dt_max, dt_max / dt);
+
+	apply_boundary_conditions(conc_old, nx, ny, nm);
+	free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy);
+
+	for (step = start; step < steps; ) {
+		const int next = (step / checks + 1) * checks;
+		const int stop = (next < steps) ? next : steps;
+		const fp_t t_stop = elapsed + (stop - step) * dt;
+
+		while (t_stop - elapsed > 1.0e-6 * dt) {
+			fp_t energy_new;
+
+			start_time = GetTimer();
+			adapt_save(conc_old, elapsed);
+			watch.step += GetTimer() - start_time;
+
+			for (int n = 0; n < adapt_interval() && t_stop - elapsed > 1.0e-6 * dt; n++) {
+				const fp_t h = adapt_dt(t_stop - elapsed);
+
+				/* === Start Architecture-Specific Kernel === */
+				#ifdef FUSED
+				start_time = GetTimer();
+				compute_fused_step(conc_old, conc_win, conc_new, mask_lap, kappa, nx, ny, nm, M, h);
+				watch.conv += GetTimer() - start_time;
+				#else
+				start_time = GetTimer();
+				compute_laplacian(conc_old, conc_lap, mask_lap, kappa, nx, ny, nm);
+				watch.conv += GetTimer() - start_time;
+
+				apply_boundary_conditions(conc_lap, nx, ny, nm);
+
+				start_time = GetTimer();
+				compute_divergence(conc_lap, conc_div, mask_lap, nx, ny, nm);
+				watch.conv += GetTimer() - start_time;
+
+				start_time = GetTimer();
+				update_composition(conc_old, conc_div, conc_new, nx, ny, nm, M, h);
+				watch.step += GetTimer() - start_time;
+				#endif
+
+				swap_pointers(&conc_old, &conc_new);
+				apply_boundary_conditions(conc_old, nx, ny, nm);
+				elapsed += h;
+				/* === Finish Architecture-Specific Kernel === */
+			}
+
+			start_time = GetTimer();
+			free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy_new);
+			if (adapt_accept(conc_old, energy, energy_new, &elapsed))
+				energy = energy_new;
+			watch.step += GetTimer() - start_time;
+		}
+
+		elapsed = t_stop;
+		step = stop;
+		print_progress(step, steps);
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
+					watch.conv, watch.step, watch.file, GetTimer());
+			adapt_log(output);
+			fflush(output);
+		}
+	}
+	adapt_free();
+	#elif defined(SLAB_SYNC)
+	/* One team for the whole run, each thread owning a fixed slab of rows.
+	   Instead of barriers, a thread waits only for the slabs whose rows its
+	   stencil reaches to finish the same phase. Checkpoints still stop everyone,
+	   and the whole team sums the free energy. */
+	fp_t* partial = (fp_t*)malloc(ny * sizeof(fp_t));
+
+	#pragma omp parallel private(step, start_time)
+	{
+		const int tid = omp_get_thread_num();
+		fp_t** field_old = conc_old;
+		fp_t** field_new = conc_new;
+		int jlo, jhi;
+
+		/* the fused sweep reads conc_old two stencil radii beyond its slab */
+		#ifdef FUSED
+		const int halo = 2 * (nm/2);
+		#else
+		const int halo = nm/2;
+		#endif
+
+		slab_bounds(tid, omp_get_num_threads(), ny, nm, &jlo, &jhi);
+
+		#pragma omp single
+		slab_init(omp_get_num_threads(), ny, nm, halo);
+
+		for (step = start+1; step < steps+1; step++) {
+			const long phase = step - start;
+
+			#pragma omp master
+			{
+				print_progress(step, steps);
+				start_time = GetTimer();
+			}
+
+			/* === Start Architecture-Specific Kernel === */
+			#ifndef FUSED_BC
+			apply_boundary_slab(field_old, jlo, jhi, nx, ny, nm);
+			#endif
+
+			#ifdef FUSED
+			slab_signal(tid, phase);
+			slab_wait(tid, phase);
+
+			compute_fused_step_team(field_old, conc_win, field_new, mask_lap, kappa, nx, ny, nm, M, dt);
+
+			#pragma omp master
+			watch.conv += GetTimer() - start_time;
+			#else
+			/* two phases per step: boundaries of conc_old, then of conc_lap */
+			slab_signal(tid, 2*phase-1);
+			slab_wait(tid, 2*phase-1);
+
+			compute_laplacian_slab(field_old, conc_lap, mask_lap, kappa, jlo, jhi, nx, ny, nm);
+
+			slab_signal(tid, 2*phase);
+			slab_wait(tid, 2*phase);
+
+			compute_divergence_slab(conc_lap, conc_div, mask_lap, jlo, jhi, nx, nm);
+
+			#pragma omp master
+			{
+				watch.conv += GetTimer() - start_time;
+				start_time = GetTimer();
+			}
+
+			update_composition_slab(field_old, conc_div, field_new, jlo, jhi, nx, ny, nm, M, dt);
+
+			#pragma omp master
+			watch.step += GetTimer() - start_time;
+			#endif
+
+			swap_pointers(&field_old, &field_new);
+			/* === Finish Architecture-Specific Kernel === */
+
+			#pragma omp master
+			elapsed += dt;
+
+			if (step % checks == 0) {
+				/* every slab must be finished before the master reads the field */
+				#pragma omp barrier
+
+				#pragma omp master
+				{
+					start_time = GetTimer();
+					queue_output(field_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+					watch.file += GetTimer() - start_time;
+				}
+
+				/* ends with a barrier, so no slab moves on before the writer has
+				   copied the field */
+				free_energy_team(field_old, dx, dy, nx, ny, nm, kappa, partial, &energy);
+
+				#pragma omp master
+				{
+					fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
+							watch.conv, watch.step, watch.file, GetTimer());
+					fflush(output);
+				}
+			}
+		}
+
+		#pragma omp master
+		{
+			conc_old = field_old;
+			conc_new = field_new;
+		}
+	}
+	slab_free();
+	free(partial);
+	#elif defined(PERSISTENT)
+	/* One team for the whole run. Each thread swaps its own copies of the
+	   field pointers; the master alone times, logs, and writes checkpoints,
+	   but the whole team sums the free energy. */
+	fp_t* partial = (fp_t*)malloc(ny * sizeof(fp_t));
+
+	#pragma omp parallel private(step, start_time)
+	{
+		fp_t** field_old = conc_old;
+		fp_t** field_new = conc_new;
+
+		for (step = start+1; step < steps+1; step++) {
+			#pragma omp master
+			{
+				print_progress(step, steps);
+				start_time = GetTimer();
+			}
+
+			/* === Start Architecture-Specific Kernel === */
+			#ifndef FUSED_BC
+			apply_boundary_conditions_team(field_old, nx, ny, nm);
+			#endif
+
+			#ifdef FUSED
+			compute_fused_step_team(field_old, conc_win, field_new, mask_lap, kappa, nx, ny, nm, M, dt);
+			#pragma omp barrier
+
+			#pragma omp master
+			watch.conv += GetTimer() - start_time;
+			#else
+			compute_laplacian_team(field_old, conc_lap, mask_lap, kappa, nx, ny, nm);
+
+			#ifndef FUSED_BC
+			apply_boundary_conditions_team(conc_lap, nx, ny, nm);
+			#endif
+
+			/* no barrier: each thread updates the rows whose divergence it took */
+			compute_divergence_team(conc_lap, conc_div, mask_lap, nx, ny, nm);
+
+			#pragma omp master
+			{
+				watch.conv += GetTimer() - start_time;
+				start_time = GetTimer();
+			}
+
+			update_composition_team(field_old, conc_div, field_new, nx, ny, nm, M, dt);
+			#pragma omp barrier
+
+			#pragma omp master
+			watch.step += GetTimer() - start_time;
+			#endif
+
+			swap_pointers(&field_old, &field_new);
+			/* === Finish Architecture-Specific Kernel === */
+
+			#pragma omp master
+			elapsed += dt;
+
+			if (step % checks == 0) {
+				#pragma omp master
+				{
+					start_time = GetTimer();
+					queue_output(field_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+					watch.file += GetTimer() - start_time;
+				}
+
+				/* ends with a barrier, so the next step cannot overwrite the field
+				   before the writer has copied it */
+				free_energy_team(field_old, dx, dy, nx, ny, nm, kappa, partial, &energy);
+
+				#pragma omp master
+				{
+					fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
+							watch.conv, watch.step, watch.file, GetTimer());
+					fflush(output);
+				}
+			}
+		}
+
+		#pragma omp master
+		{
+			conc_old = field_old;
+			conc_new = field_new;
+		}
+	}
+	free(partial);
+	#else
+	for (step = start+1; step < steps+1; step++) {
 		print_progress(step, steps);
 
 		/* === Start Architecture-Specific Kernel === */
+		#ifndef FUSED_BC
 		apply_boundary_conditions(conc_old, nx, ny, nm);
+		#endif
 
+		#ifdef FUSED
+		start_time = GetTimer();
+		compute_fused_step(conc_old, conc_win, conc_new, mask_lap, kappa, nx, ny, nm, M, dt);
+		watch.conv += GetTimer() - start_time;
+		#else
 		start_time = GetTimer();
 		compute_laplacian(conc_old, conc_lap, mask_lap, kappa, nx, ny, nm);
 		watch.conv += GetTimer() - start_time;
 
+		#ifndef FUSED_BC
 		apply_boundary_conditions(conc_lap, nx, ny, nm);
+		#endif
 
 		start_time = GetTimer();
 		compute_divergence(conc_lap, conc_div, mask_lap, nx, ny, nm);
@@ -89,6 +407,7 @@ int main(int argc, char* argv[])
 		start_time = GetTimer();
 		update_composition(conc_old, conc_div, conc_new, nx, ny, nm, M, dt);
 		watch.step += GetTimer() - start_time;
+		#endif
 
 		swap_pointers(&conc_old, &conc_new);
 		elapsed += dt;
@@ -96,10 +415,10 @@ int main(int argc, char* argv[])
 
 		if (step % checks == 0) {
 			start_time = GetTimer();
-			write_png(conc_old, nx, ny, dt*step);
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
 			watch.file += GetTimer() - start_time;
 
-			free_energy(conc_old, conc_lap, dx, dy, nx, ny, nm, kappa, &energy);
+			free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy);
 
 			fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
 					watch.conv, watch.step, watch.file, GetTimer());
@@ -107,11 +426,21 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	write_csv(conc_old, nx, ny, dx, dy, dt*steps);
+	#endif
+
+	if (steps > start)
+		fprintf(output, "# %d steps, %.3f us/step\n", steps - start,
+		        1.0e6 * (GetTimer() - loop_start) / (steps - start));
+
+	queue_output(conc_old, WRITE_CSV, steps, elapsed);
 
 	/* clean up */
+	stop_writer();
 	fclose(output);
 	free_arrays(conc_old, conc_new, conc_lap, conc_div, mask_lap);
+	#ifdef FUSED
+	free(conc_win);
+	#endif
 
 	return 0;
 }
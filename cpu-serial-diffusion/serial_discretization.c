@@ -9,6 +9,7 @@
 */
 
 #include <math.h>
+#include <stdlib.h>
 #include "boundaries.h"
 #include "mesh.h"
 #include "numerics.h"
@@ -18,15 +19,7 @@ void compute_convolution(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
                          const int nx, const int ny, const int nm)
 {
 	for (int j = nm/2; j < ny-nm/2; j++) {
-		for (int i = nm/2; i < nx-nm/2; i++) {
-			fp_t value = 0.0;
-			for (int mj = -nm/2; mj < nm/2+1; mj++) {
-				for (int mi = -nm/2; mi < nm/2+1; mi++) {
-					value += mask_lap[mj+nm/2][mi+nm/2] * conc_old[j+mj][i+mi];
-				}
-			}
-			conc_lap[j][i] = value;
-		}
+		convolve_row(conc_old, conc_lap[j], mask_lap, j, nm/2, nx-nm/2, nm);
 	}
 }
 
@@ -40,3 +33,174 @@ void update_composition(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
 		}
 	}
 }
+
+void update_stage(fp_t** conc_old, fp_t** lap_old, fp_t** stage_1, fp_t** stage_2,
+                  fp_t** conc_lap, fp_t** stage, const int nx, const int ny, const int nm,
+                  const fp_t mu, const fp_t nu, const fp_t mu_dt, const fp_t gamma_dt)
+{
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		for (int i = nm/2; i < nx-nm/2; i++) {
+			stage[j][i] = mu * stage_1[j][i] + nu * stage_2[j][i] + (1. - mu - nu) * conc_old[j][i]
+			            + mu_dt * conc_lap[j][i] + gamma_dt * lap_old[j][i];
+		}
+	}
+}
+
+/**
+ \brief Fixed state shared by every trapezoid of one compute_trapezoid() call
+*/
+struct Trapezoid {
+	fp_t** field[2];  /**< \a field[t % 2] holds step \a t, counted from the call */
+	fp_t** conc_lap;  /**< scratch for one row of the Laplacian at a time */
+	fp_t** mask_lap;  /**< convolution mask */
+	fp_t** halo;      /**< \a nm rows of scratch for rows near the boundaries */
+	fp_t D;           /**< diffusivity */
+	fp_t dt;          /**< timestep */
+	int bx;           /**< narrowest trapezoid worth cutting along \a x */
+	int by;           /**< narrowest trapezoid worth cutting along \a y */
+	int nx;           /**< mesh points along \a x, halo included */
+	int ny;           /**< mesh points along \a y, halo included */
+	int nm;           /**< mask size */
+};
+
+/**
+ \brief Value of \a conc at \a (i,j) as apply_boundary_conditions() would leave it
+
+ Ghost cells mirror the nearest interior cell, and the half-walls read 1.
+*/
+static fp_t bounded_value(fp_t** conc, int i, int j, const int nx, const int ny, const int nm)
+{
+	j = (j < nm/2) ? nm/2 : (j > ny-1-nm/2) ? ny-1-nm/2 : j;
+	i = (i < nm/2) ? nm/2 : (i > nx-1-nm/2) ? nx-1-nm/2 : i;
+
+	if ((j < ny/2 && i == nm/2) || (j >= ny/2 && i == nx-1-nm/2))
+		return 1.;
+
+	return conc[j][i];
+}
+
+/**
+ \brief Advance columns [\a ilo, \a ihi) of row \a j from \a old to \a new
+
+ Where the stencil reaches a ghost cell or a half-wall, the neighborhood is
+ first copied into \a z->halo with boundary values applied, so the cells see
+ exactly what the stepwise sweep would give them.
+*/
+static void trapezoid_row(const struct Trapezoid* z, fp_t** old, fp_t** new,
+                          const int j, const int ilo, const int ihi, const int bounded)
+{
+	const int nm = z->nm;
+	fp_t* lap = z->conc_lap[j];
+
+	if (!bounded) {
+		convolve_row(old, lap, z->mask_lap, j, ilo, ihi, nm);
+		for (int i = ilo; i < ihi; i++)
+			new[j][i] = old[j][i] + z->dt * z->D * lap[i];
+		return;
+	}
+
+	/* halo row k holds row j-nm/2+k, from column ilo-nm/2 */
+	for (int k = 0; k < nm; k++)
+		for (int i = ilo - nm/2; i < ihi + nm/2; i++)
+			z->halo[k][i - ilo + nm/2] = bounded_value(old, i, j - nm/2 + k, z->nx, z->ny, nm);
+
+	convolve_row(z->halo, &lap[ilo - nm/2], z->mask_lap, nm/2, nm/2, ihi - ilo + nm/2, nm);
+	for (int i = ilo; i < ihi; i++)
+		new[j][i] = z->halo[nm/2][i - ilo + nm/2] + z->dt * z->D * lap[i];
+}
+
+/**
+ \brief Advance every step of the trapezoid, one box at a time
+*/
+static void trapezoid_base(const struct Trapezoid* z, const int t0, const int t1,
+                           int x0, const int dx0, int x1, const int dx1,
+                           int y0, const int dy0, int y1, const int dy1)
+{
+	const int r = z->nm / 2;
+
+	/* columns and rows whose stencil stays clear of ghost cells and half-walls */
+	const int ilo = 2*r + 1, ihi = z->nx - 1 - 2*r;
+	const int jlo = 2*r, jhi = z->ny - 2*r;
+
+	for (int t = t0; t < t1; t++) {
+		fp_t** old = z->field[t % 2];
+		fp_t** new = z->field[(t + 1) % 2];
+
+		for (int j = y0; j < y1; j++) {
+			if (j < jlo || j >= jhi || ihi <= ilo) {
+				trapezoid_row(z, old, new, j, x0, x1, 1);
+				continue;
+			}
+
+			const int a = (x0 > ilo) ? x0 : (x1 < ilo) ? x1 : ilo;
+			const int b = (x1 < ihi) ? x1 : (a > ihi) ? a : ihi;
+
+			if (x0 < a)
+				trapezoid_row(z, old, new, j, x0, a, 1);
+			if (a < b)
+				trapezoid_row(z, old, new, j, a, b, 0);
+			if (b < x1)
+				trapezoid_row(z, old, new, j, b, x1, 1);
+		}
+
+		x0 += dx0; x1 += dx1;
+		y0 += dy0; y1 += dy1;
+	}
+}
+
+/**
+ \brief Recursive space-time decomposition after Frigo and Strumpen
+
+ Covers steps [\a t0, \a t1) of the box whose edges start at \a x0, \a x1,
+ \a y0, and \a y1 and move by \a dx0, \a dx1, \a dy0, and \a dy1 each step.
+ Trapezoids that are wide for their height are cut along a sloped line into
+ two that can run in order; the rest are cut in time. Small ones run as is.
+*/
+static void trapezoid_walk(const struct Trapezoid* z, const int t0, const int t1,
+                           const int x0, const int dx0, const int x1, const int dx1,
+                           const int y0, const int dy0, const int y1, const int dy1)
+{
+	const int r = z->nm / 2;
+	const int dt = t1 - t0;
+
+	/* widest extent of the trapezoid, at its base or its top */
+	const int wx = (dx1 - dx0 > 0) ? x1 - x0 + (dx1 - dx0) * dt : x1 - x0;
+	const int wy = (dy1 - dy0 > 0) ? y1 - y0 + (dy1 - dy0) * dt : y1 - y0;
+
+	if (dt > 1 && wx >= 2 * z->bx && 2*(x1 - x0) + (dx1 - dx0) * dt >= 4 * r * dt) {
+		const int xm = (2*(x0 + x1) + (2*r + dx0 + dx1) * dt) / 4;
+		trapezoid_walk(z, t0, t1, x0, dx0, xm, -r, y0, dy0, y1, dy1);
+		trapezoid_walk(z, t0, t1, xm, -r, x1, dx1, y0, dy0, y1, dy1);
+	} else if (dt > 1 && wy >= 2 * z->by && 2*(y1 - y0) + (dy1 - dy0) * dt >= 4 * r * dt) {
+		const int ym = (2*(y0 + y1) + (2*r + dy0 + dy1) * dt) / 4;
+		trapezoid_walk(z, t0, t1, x0, dx0, x1, dx1, y0, dy0, ym, -r);
+		trapezoid_walk(z, t0, t1, x0, dx0, x1, dx1, ym, -r, y1, dy1);
+	} else if (dt > 1 && (wx >= 2 * z->bx || wy >= 2 * z->by)) {
+		const int s = dt / 2;
+		trapezoid_walk(z, t0, t0 + s, x0, dx0, x1, dx1, y0, dy0, y1, dy1);
+		trapezoid_walk(z, t0 + s, t1, x0 + dx0 * s, dx0, x1 + dx1 * s, dx1,
+		                              y0 + dy0 * s, dy0, y1 + dy1 * s, dy1);
+	} else {
+		trapezoid_base(z, t0, t1, x0, dx0, x1, dx1, y0, dy0, y1, dy1);
+	}
+}
+
+void compute_trapezoid(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new, fp_t** mask_lap,
+                       const int bx, const int by, const int nx, const int ny, const int nm,
+                       const fp_t D, const fp_t dt, const int steps)
+{
+	fp_t* rows = (fp_t*)malloc(nm * nx * sizeof(fp_t));
+	fp_t* halo[MAX_MASK_H];
+
+	for (int k = 0; k < nm; k++)
+		halo[k] = &rows[k * nx];
+
+	const struct Trapezoid z = {
+		{conc_old, conc_new}, conc_lap, mask_lap, halo, D, dt,
+		(bx > 1) ? bx : 1, (by > 1) ? by : 1, nx, ny, nm
+	};
+
+	trapezoid_walk(&z, 0, steps, nm/2, 0, nx-nm/2, 0, nm/2, 0, ny-nm/2, 0);
+
+	free(rows);
+}
@@ -17,7 +17,9 @@
 #include "mesh.h"
 #include "numerics.h"
 #include "output.h"
+#include "rkl.h"
 #include "timer.h"
+#include "writer.h"
 
 /**
  \brief Run simulation using input parameters specified on the command line
@@ -40,14 +42,17 @@ int main(int argc, char* argv[])
 	fp_t dx=0.5, dy=0.5, h;
 
 	/* declare default materials and numerical parameters */
-	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0.;
+	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0., rss_err=0.;
 	int step=0, steps=100000, checks=10000;
 	double start_time=0.;
 	struct Stopwatch watch = {0., 0., 0., 0.};
 
 	StartTimer();
 
-	param_parser(argc, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab, &nm, &nx, &ny, &steps);
+	/* an optional second argument names a checkpoint to restart from */
+	const char* restart = (argc == 3) ? argv[2] : NULL;
+
+	param_parser((restart == NULL) ? argc : 2, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab, &nm, &nx, &ny, &steps);
 
 	h = (dx > dy) ? dy : dx;
 	dt = (linStab * h * h) / (4.0 * D);
@@ -55,32 +60,121 @@ int main(int argc, char* argv[])
 	/* initialize memory */
 	make_arrays(&conc_old, &conc_new, &conc_lap, &mask_lap, nx, ny, nm);
 	set_mask(dx, dy, code, mask_lap, nm);
+	start_writer(nx, ny, nm, dx, dy, WRITER_DEPTH);
 
 	print_progress(0, steps);
 
 	start_time = GetTimer();
 	apply_initial_conditions(conc_old, nx, ny, nm);
+	if (restart != NULL)
+		read_checkpoint(restart, conc_old, nx, ny, nm, dx, dy, &step, &elapsed);
+	const int start = step;
 	watch.step = GetTimer() - start_time;
 
-	/* prepare to log comparison to analytical solution */
-	output = fopen("runlog.csv", "w");
+	/* prepare to log comparison to analytical solution, continuing the old log on restart */
+	output = fopen("runlog.csv", (restart == NULL) ? "w" : "a");
 	if (output == NULL) {
 		printf("Error: unable to %s for output. Check permissions.\n", "runlog.csv");
 		exit(-1);
 	}
 	watch.file = GetTimer() - start_time;
 
-	fprintf(output, "iter,sim_time,wrss,conv_time,step_time,IO_time,soln_time,run_time\n");
-	fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
-			watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+	if (restart == NULL) {
+		fprintf(output, "iter,sim_time,wrss,conv_time,step_time,IO_time,soln_time,run_time\n");
+		fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+				watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+	}
 	fflush(output);
 
 	/* write initial condition data */
 	start_time = GetTimer();
-	write_png(conc_old, nx, ny, 0);
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
 
 	/* do the work */
-	for (step = 1; step < steps+1; step++) {
+	#if defined(TRAPEZOID)
+	for (step = start; step < steps; ) {
+		/* steps are not separable within a trapezoid: run to the next checkpoint */
+		const int stop = (step / checks + 1) * checks;
+		const int chunk = ((stop < steps) ? stop : steps) - step;
+
+		print_progress(step + chunk, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		start_time = GetTimer();
+		compute_trapezoid(conc_old, conc_lap, conc_new, mask_lap, bx, by, nx, ny, nm, D, dt, chunk);
+		watch.step += GetTimer() - start_time;
+
+		if (chunk % 2 == 1)
+			swap_pointers(&conc_old, &conc_new);
+		for (int n = 0; n < chunk; n++)
+			elapsed += dt;
+		step += chunk;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			start_time = GetTimer();
+			check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+			watch.soln += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
+			fflush(output);
+		}
+	}
+	#elif defined(RKL2)
+	/* each super-step spans scale explicit steps, which must divide the checkpoint
+	   interval: as many as keep every mode accurate, unless told otherwise */
+	int scale = (getenv("HIPERC_DT_SCALE") != NULL) ? atoi(getenv("HIPERC_DT_SCALE"))
+	                                                : rkl_scale(mask_lap, nm, D, dt, checks);
+	if (scale < 1)
+		scale = 1;
+	while (checks % scale != 0)
+		scale--;
+
+	/* stop short of steps if the last stride would pass it */
+	steps = start + (steps - start) / scale * scale;
+	dt *= scale;
+
+	rkl_init(mask_lap, nx, ny, nm, D, dt);
+	fprintf(output, "# rkl2 dt=%f, %d stages, %d explicit steps per step\n", dt, rkl_stages(), scale);
+
+	/* Steps, checkpoints, and file names still count explicit steps, so the
+	   log lines up with the explicit builds'. */
+	for (step = start+scale; step < steps+1; step += scale) {
+		print_progress(step, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		rkl_step(conc_old, conc_lap, conc_new, mask_lap, nx, ny, nm, &watch);
+
+		swap_pointers(&conc_old, &conc_new);
+		elapsed += dt;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			start_time = GetTimer();
+			check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+			watch.soln += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
+			fflush(output);
+		}
+	}
+	rkl_free();
+	#else
+	for (step = start+1; step < steps+1; step++) {
 		print_progress(step, steps);
 
 		/* === Start Architecture-Specific Kernel === */
@@ -100,22 +194,26 @@ int main(int argc, char* argv[])
 
 		if (step % checks == 0) {
 			start_time = GetTimer();
-			write_png(conc_old, nx, ny, step);
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
 			watch.file += GetTimer() - start_time;
 
 			start_time = GetTimer();
-			check_solution(conc_old, conc_lap, nx, ny, dx, dy, nm, elapsed, D, &rss);
+			check_solution(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
 			watch.soln += GetTimer() - start_time;
 
 			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
 					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
 			fflush(output);
 	   }
 	}
+	#endif
 
-	write_csv(conc_old, nx, ny, dx, dy, steps);
+	queue_output(conc_old, WRITE_CSV, steps, elapsed);
 
 	/* clean up */
+	stop_writer();
 	fclose(output);
 	free_arrays(conc_old, conc_new, conc_lap, mask_lap);
 
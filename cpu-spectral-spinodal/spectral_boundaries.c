@@ -0,0 +1,58 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  spectral_boundaries.c
+ \brief Implementation of CHiMaD 1a (periodic) boundary conditions with OpenMP threading
+*/
+
+#include <math.h>
+#include <omp.h>
+#include <string.h>
+#include "boundaries.h"
+
+void apply_initial_conditions(fp_t** conc, const int nx, const int ny, const int nm)
+{
+	const fp_t C0 = 0.50;
+	const fp_t ep = 0.01;
+
+	#pragma omp parallel
+	{
+		#pragma omp for collapse(2)
+		for (int j = 0; j < ny; j++) {
+			for (int i = 0; i < nx; i++) {
+				const int y = j - nm/2;
+				const int x = i - nm/2;
+				conc[j][i] = C0 + ep * (  cos(0.105 * x) * cos(0.110 * y)
+										+ cos(0.130 * x) * cos(0.087 * y)
+										* cos(0.130 * x) * cos(0.087 * y)
+										+ cos(0.025 * x - 0.150 * y)
+										* cos(0.070 * x - 0.020 * y)
+										);
+			}
+		}
+	}
+}
+
+void apply_boundary_conditions(fp_t** conc, const int nx, const int ny, const int nm)
+{
+	/* periodic boundaries: ghost cells copy the far side of the interior */
+	const int ni = nx - 2*(nm/2);
+	const int nj = ny - 2*(nm/2);
+
+	#pragma omp parallel for
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		for (int offset = 0; offset < nm/2; offset++) {
+			conc[j][offset] = conc[j][offset + ni];           /* left condition */
+			conc[j][nx-1-offset] = conc[j][nx-1-offset - ni]; /* right condition */
+		}
+	}
+
+	/* whole rows, so the corners come along */
+	for (int offset = 0; offset < nm/2; offset++) {
+		memcpy(conc[offset], conc[offset + nj], nx * sizeof(fp_t));           /* bottom condition */
+		memcpy(conc[ny-1-offset], conc[ny-1-offset - nj], nx * sizeof(fp_t)); /* top condition */
+	}
+}
@@ -0,0 +1,381 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  spectral_discretization.c
+ \brief Implementation of the semi-implicit Fourier-spectral step with OpenMP threading
+*/
+
+#include <math.h>
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mesh.h"
+#include "numerics.h"
+
+/**
+ \brief Largest number of prime factors in a transform length
+*/
+#define FFT_MAX_FACTORS 32
+
+/**
+ \brief Mixed-radix plan for complex transforms of length \a n
+
+ Complex values are stored as interleaved (real, imaginary) pairs of \c fp_t.
+*/
+struct Plan {
+	int n;                        /**< transform length */
+	int nf;                       /**< number of factors */
+	int factors[FFT_MAX_FACTORS]; /**< radices, largest powers of 4 and 2 first */
+	fp_t* twiddle[2];             /**< \f$ e^{\mp 2\pi i k/n} \f$ for forward and inverse */
+};
+
+static struct Plan xplan, yplan;
+
+/* transformed field, ny-2(nm/2) rows of nx-2(nm/2) complex values */
+static fp_t* spec;
+
+/* minus the symbol of the Laplacian, one per wavenumber */
+static fp_t* spec_k2;
+
+/* two complex lines per thread, as long as the longer side */
+static fp_t* scratch;
+static int scratch_len;
+
+fp_t dfdc(const fp_t C)
+{
+	const fp_t Ca  = 0.3;
+	const fp_t Cb  = 0.7;
+	const fp_t rho = 5.0;
+
+	const fp_t A = C - Ca;
+	const fp_t B = Cb - C;
+
+	return 2.0 * rho * A * B * (Ca + Cb - 2.0 * C);
+}
+
+static void plan_init(struct Plan* plan, const int n)
+{
+	int m = n;
+	int p = 4;
+
+	plan->n = n;
+	plan->nf = 0;
+
+	while (m > 1) {
+		while (m % p != 0)
+			p = (p == 4) ? 2 : (p == 2) ? 3 : p + 2;
+		plan->factors[plan->nf++] = p;
+		m /= p;
+	}
+
+	/* a single point transforms to itself */
+	if (plan->nf == 0)
+		plan->factors[plan->nf++] = 1;
+
+	for (int s = 0; s < 2; s++) {
+		const double sign = (s == 0) ? -1.0 : 1.0;
+		plan->twiddle[s] = (fp_t*)malloc(2 * n * sizeof(fp_t));
+		for (int k = 0; k < n; k++) {
+			plan->twiddle[s][2*k]   = cos(2.0 * M_PI * k / n);
+			plan->twiddle[s][2*k+1] = sign * sin(2.0 * M_PI * k / n);
+		}
+	}
+}
+
+static void plan_free(struct Plan* plan)
+{
+	free(plan->twiddle[0]);
+	free(plan->twiddle[1]);
+}
+
+/**
+ \brief Recursive decimation in time: \a out gets the transform of every
+ \a stride-th value of \a in, \a n of them
+*/
+static void fft_rec(fp_t* out, const fp_t* in, const int n, const int stride,
+                    const int* factors, const struct Plan* plan, const fp_t* tw)
+{
+	const int p = factors[0];
+	const int m = n / p;
+	const int ts = plan->n / n;
+
+	if (m == 1) {
+		for (int r = 0; r < p; r++) {
+			out[2*r]   = in[2*r*stride];
+			out[2*r+1] = in[2*r*stride+1];
+		}
+	} else {
+		for (int r = 0; r < p; r++)
+			fft_rec(out + 2*r*m, in + 2*r*stride, m, stride * p, factors + 1, plan, tw);
+	}
+
+	/* butterflies joining the p sub-transforms of length m */
+	if (p == 2) {
+		for (int k = 0; k < m; k++) {
+			fp_t* a = out + 2*k;
+			fp_t* b = out + 2*(k+m);
+			const fp_t wr = tw[2*k*ts], wi = tw[2*k*ts+1];
+			const fp_t tr = b[0] * wr - b[1] * wi;
+			const fp_t ti = b[0] * wi + b[1] * wr;
+			b[0] = a[0] - tr;
+			b[1] = a[1] - ti;
+			a[0] += tr;
+			a[1] += ti;
+		}
+	} else if (p == 4) {
+		/* multiplying by -i going forward, +i going back; likewise for 3 and 5 */
+		const fp_t rot = (tw == plan->twiddle[0]) ? 1.0 : -1.0;
+		for (int k = 0; k < m; k++) {
+			fp_t t[8];
+			for (int r = 0; r < 4; r++) {
+				const fp_t* v = out + 2*(k + r*m);
+				const fp_t wr = tw[2*r*k*ts], wi = tw[2*r*k*ts+1];
+				t[2*r]   = v[0] * wr - v[1] * wi;
+				t[2*r+1] = v[0] * wi + v[1] * wr;
+			}
+			const fp_t s0r = t[0] + t[4], s0i = t[1] + t[5];
+			const fp_t d0r = t[0] - t[4], d0i = t[1] - t[5];
+			const fp_t s1r = t[2] + t[6], s1i = t[3] + t[7];
+			const fp_t d1r = rot * (t[3] - t[7]), d1i = -rot * (t[2] - t[6]);
+			out[2*k]           = s0r + s1r;
+			out[2*k+1]         = s0i + s1i;
+			out[2*(k+m)]       = d0r + d1r;
+			out[2*(k+m)+1]     = d0i + d1i;
+			out[2*(k+2*m)]     = s0r - s1r;
+			out[2*(k+2*m)+1]   = s0i - s1i;
+			out[2*(k+3*m)]     = d0r - d1r;
+			out[2*(k+3*m)+1]   = d0i - d1i;
+		}
+	} else if (p == 3) {
+		const fp_t h = 0.5 * sqrt(3.0) * ((tw == plan->twiddle[0]) ? 1.0 : -1.0);
+		for (int k = 0; k < m; k++) {
+			fp_t t[6];
+			for (int r = 0; r < 3; r++) {
+				const fp_t* v = out + 2*(k + r*m);
+				const fp_t wr = tw[2*r*k*ts], wi = tw[2*r*k*ts+1];
+				t[2*r]   = v[0] * wr - v[1] * wi;
+				t[2*r+1] = v[0] * wi + v[1] * wr;
+			}
+			const fp_t sr = t[2] + t[4], si = t[3] + t[5];
+			const fp_t dr = t[2] - t[4], di = t[3] - t[5];
+			const fp_t mr = t[0] - 0.5 * sr, mi = t[1] - 0.5 * si;
+			out[2*k]         = t[0] + sr;
+			out[2*k+1]       = t[1] + si;
+			out[2*(k+m)]     = mr + h * di;
+			out[2*(k+m)+1]   = mi - h * dr;
+			out[2*(k+2*m)]   = mr - h * di;
+			out[2*(k+2*m)+1] = mi + h * dr;
+		}
+	} else if (p == 5) {
+		const fp_t rot = (tw == plan->twiddle[0]) ? 1.0 : -1.0;
+		const fp_t c1 = cos(0.4 * M_PI), c2 = cos(0.8 * M_PI);
+		const fp_t s1 = rot * sin(0.4 * M_PI), s2 = rot * sin(0.8 * M_PI);
+		for (int k = 0; k < m; k++) {
+			fp_t t[10];
+			for (int r = 0; r < 5; r++) {
+				const fp_t* v = out + 2*(k + r*m);
+				const fp_t wr = tw[2*r*k*ts], wi = tw[2*r*k*ts+1];
+				t[2*r]   = v[0] * wr - v[1] * wi;
+				t[2*r+1] = v[0] * wi + v[1] * wr;
+			}
+			const fp_t s14r = t[2] + t[8], s14i = t[3] + t[9];
+			const fp_t d14r = t[2] - t[8], d14i = t[3] - t[9];
+			const fp_t s23r = t[4] + t[6], s23i = t[5] + t[7];
+			const fp_t d23r = t[4] - t[6], d23i = t[5] - t[7];
+			const fp_t a1r = t[0] + c1 * s14r + c2 * s23r, a1i = t[1] + c1 * s14i + c2 * s23i;
+			const fp_t a2r = t[0] + c2 * s14r + c1 * s23r, a2i = t[1] + c2 * s14i + c1 * s23i;
+			const fp_t b1r = s1 * d14r + s2 * d23r, b1i = s1 * d14i + s2 * d23i;
+			const fp_t b2r = s2 * d14r - s1 * d23r, b2i = s2 * d14i - s1 * d23i;
+			out[2*k]         = t[0] + s14r + s23r;
+			out[2*k+1]       = t[1] + s14i + s23i;
+			out[2*(k+m)]     = a1r + b1i;
+			out[2*(k+m)+1]   = a1i - b1r;
+			out[2*(k+2*m)]   = a2r + b2i;
+			out[2*(k+2*m)+1] = a2i - b2r;
+			out[2*(k+3*m)]   = a2r - b2i;
+			out[2*(k+3*m)+1] = a2i + b2r;
+			out[2*(k+4*m)]   = a1r - b1i;
+			out[2*(k+4*m)+1] = a1i + b1r;
+		}
+	} else {
+		fp_t t[2*p];
+		for (int k = 0; k < m; k++) {
+			for (int r = 0; r < p; r++) {
+				const fp_t* v = out + 2*(k + r*m);
+				const fp_t wr = tw[2*r*k*ts], wi = tw[2*r*k*ts+1];
+				t[2*r]   = v[0] * wr - v[1] * wi;
+				t[2*r+1] = v[0] * wi + v[1] * wr;
+			}
+			for (int q = 0; q < p; q++) {
+				fp_t sr = 0., si = 0.;
+				for (int r = 0; r < p; r++) {
+					const int w = ((r * q) % p) * m * ts;
+					sr += t[2*r] * tw[2*w]   - t[2*r+1] * tw[2*w+1];
+					si += t[2*r] * tw[2*w+1] + t[2*r+1] * tw[2*w];
+				}
+				out[2*(k + q*m)]   = sr;
+				out[2*(k + q*m)+1] = si;
+			}
+		}
+	}
+}
+
+/**
+ \brief Transform every row, then every column, of \a z in place; unscaled
+*/
+static void fft_2d(fp_t* z, const int ni, const int nj, const int inverse)
+{
+	#pragma omp parallel
+	{
+		fp_t* a = scratch + 4 * scratch_len * omp_get_thread_num();
+		fp_t* b = a + 2 * scratch_len;
+
+		#pragma omp for
+		for (int j = 0; j < nj; j++) {
+			fp_t* row = z + 2 * ni * j;
+			memcpy(a, row, 2 * ni * sizeof(fp_t));
+			fft_rec(row, a, ni, 1, xplan.factors, &xplan, xplan.twiddle[inverse]);
+		}
+
+		#pragma omp for
+		for (int i = 0; i < ni; i++) {
+			for (int j = 0; j < nj; j++) {
+				a[2*j]   = z[2 * (ni * j + i)];
+				a[2*j+1] = z[2 * (ni * j + i) + 1];
+			}
+			fft_rec(b, a, nj, 1, yplan.factors, &yplan, yplan.twiddle[inverse]);
+			for (int j = 0; j < nj; j++) {
+				z[2 * (ni * j + i)]     = b[2*j];
+				z[2 * (ni * j + i) + 1] = b[2*j+1];
+			}
+		}
+	}
+}
+
+void spectral_init(fp_t** const mask_lap, const int code,
+                   const fp_t dx, const fp_t dy,
+                   const int nx, const int ny, const int nm)
+{
+	const int ni = nx - 2*(nm/2);
+	const int nj = ny - 2*(nm/2);
+	const int from_mask = (code == 53 || code == 93);
+
+	plan_init(&xplan, ni);
+	plan_init(&yplan, nj);
+
+	scratch_len = (ni > nj) ? ni : nj;
+	scratch = (fp_t*)malloc(4 * scratch_len * omp_get_max_threads() * sizeof(fp_t));
+	spec = (fp_t*)malloc(2 * ni * nj * sizeof(fp_t));
+	spec_k2 = (fp_t*)malloc(ni * nj * sizeof(fp_t));
+
+	#pragma omp parallel for
+	for (int j = 0; j < nj; j++) {
+		const int kj = (j <= nj/2) ? j : j - nj;
+		const fp_t ty = 2.0 * M_PI * kj / nj;
+
+		for (int i = 0; i < ni; i++) {
+			const int ki = (i <= ni/2) ? i : i - ni;
+			const fp_t tx = 2.0 * M_PI * ki / ni;
+			fp_t k2 = 0.;
+
+			if (from_mask) {
+				/* the stencil is symmetric, so its symbol is real */
+				for (int mj = 0; mj < nm; mj++)
+					for (int mi = 0; mi < nm; mi++)
+						k2 -= mask_lap[mj][mi] * cos((mi - nm/2) * tx + (mj - nm/2) * ty);
+			} else {
+				k2 = tx * tx / (dx * dx) + ty * ty / (dy * dy);
+			}
+
+			spec_k2[ni * j + i] = k2;
+		}
+	}
+}
+
+void compute_spectral_transform(fp_t** conc_old, const int nx, const int ny, const int nm)
+{
+	const int ni = nx - 2*(nm/2);
+	const int nj = ny - 2*(nm/2);
+
+	/* composition in the real part, chemical potential in the imaginary */
+	#pragma omp parallel for
+	for (int j = 0; j < nj; j++) {
+		const fp_t* row = conc_old[j + nm/2] + nm/2;
+		fp_t* z = spec + 2 * ni * j;
+		for (int i = 0; i < ni; i++) {
+			z[2*i]   = row[i];
+			z[2*i+1] = dfdc(row[i]);
+		}
+	}
+
+	fft_2d(spec, ni, nj, 0);
+}
+
+void update_spectral_composition(fp_t** conc_new, const int nx, const int ny, const int nm,
+                                 const fp_t M, const fp_t kappa, const fp_t dt)
+{
+	const int ni = nx - 2*(nm/2);
+	const int nj = ny - 2*(nm/2);
+	const fp_t scale = 1.0 / ((fp_t)ni * nj);
+
+	/* largest curvature of the free energy between the wells */
+	const fp_t S = well_curvature();
+
+	/* Unpack c and dfdc from the Hermitian and anti-Hermitian parts of Z(k),
+	   pairing k with -k, and write c at the new time to both. Each pair is
+	   visited once, from whichever member comes first. */
+	#pragma omp parallel for
+	for (int j = 0; j < nj; j++) {
+		const int jm = (nj - j) % nj;
+		for (int i = 0; i < ni; i++) {
+			const int im = (ni - i) % ni;
+			const int a = ni * j + i;
+			const int b = ni * jm + im;
+
+			if (b < a)
+				continue;
+
+			fp_t* za = spec + 2*a;
+			fp_t* zb = spec + 2*b;
+
+			/* C(k) = (Z(k) + Z*(-k)) / 2, F(k) = (Z(k) - Z*(-k)) / 2i */
+			const fp_t cr = 0.5 * (za[0] + zb[0]), ci = 0.5 * (za[1] - zb[1]);
+			const fp_t fr = 0.5 * (za[1] + zb[1]), fi = -0.5 * (za[0] - zb[0]);
+
+			const fp_t k2 = spec_k2[a];
+			const fp_t gain = 1.0 + dt * M * S * k2;
+			const fp_t denom = 1.0 + dt * M * k2 * (S + kappa * k2);
+
+			const fp_t ur = (gain * cr - dt * M * k2 * fr) / denom;
+			const fp_t ui = (gain * ci - dt * M * k2 * fi) / denom;
+
+			/* the new field is real: its transform at -k is the conjugate */
+			za[0] = ur;
+			za[1] = ui;
+			zb[0] = ur;
+			zb[1] = -ui;
+		}
+	}
+
+	fft_2d(spec, ni, nj, 1);
+
+	#pragma omp parallel for
+	for (int j = 0; j < nj; j++) {
+		fp_t* row = conc_new[j + nm/2] + nm/2;
+		const fp_t* z = spec + 2 * ni * j;
+		for (int i = 0; i < ni; i++)
+			row[i] = scale * z[2*i];
+	}
+}
+
+void spectral_free()
+{
+	plan_free(&xplan);
+	plan_free(&yplan);
+	free(scratch);
+	free(spec);
+	free(spec_k2);
+}
@@ -0,0 +1,229 @@
+/**********************************************************************************
+ HiPerC: High Performance Computing Strategies for Boundary Value Problems
+ Written by Trevor Keller and available from https://github.com/usnistgov/hiperc
+ **********************************************************************************/
+
+/**
+ \file  spectral_main.c
+ \brief Semi-implicit Fourier-spectral implementation of spinodal decomposition
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adaptive.h"
+#include "boundaries.h"
+#include "mesh.h"
+#include "numerics.h"
+#include "output.h"
+#include "timer.h"
+#include "writer.h"
+
+/**
+ \brief Run simulation using input parameters specified on the command line
+
+ Steps and checkpoints count explicit steps of the stencil backends, and
+ files are named for the simulation time of those steps, so output lines up
+ with theirs. Each spectral step covers
+ \c HIPERC_DT_SCALE of them (default 100).
+*/
+int main(int argc, char* argv[])
+{
+	FILE * output;
+
+	/* declare default mesh size and resolution */
+	fp_t **conc_old, **conc_new;
+	fp_t mask_data[MAX_MASK_H * MAX_MASK_W] = {0.};
+	fp_t* mask_lap[MAX_MASK_H];
+	int bx=32, by=32, nx=202, ny=202, nm=3, code=53;
+	const fp_t dx=1.0, dy=1.0;
+
+	/* declare default materials and numerical parameters */
+	fp_t M=5.0, kappa=2.0, linStab=0.25, elapsed=0., energy=0.;
+	int step=0, steps=5000000, checks=100000, scale=100;
+	struct Stopwatch watch = {0., 0., 0., 0.};
+
+	StartTimer();
+
+	/* an optional second argument names a checkpoint to restart from */
+	const char* restart = (argc == 3) ? argv[2] : NULL;
+
+	param_parser((restart == NULL) ? argc : 2, argv, &bx, &by, &checks, &code, &M, &kappa, &linStab, &nm, &nx, &ny, &steps);
+
+	/* each step spans scale explicit steps, which must divide the checkpoint interval */
+	if (getenv("HIPERC_DT_SCALE") != NULL)
+		scale = atoi(getenv("HIPERC_DT_SCALE"));
+	if (scale < 1)
+		scale = 1;
+	while (checks % scale != 0)
+		scale--;
+
+	/* the explicit step, which labels the output, and the spectral one */
+	const fp_t unit = linStab / (24.0 * M * kappa);
+	const fp_t dt = scale * unit;
+
+	/* initialize memory */
+	conc_old = make_field(nx, ny, nm);
+	conc_new = make_field(nx, ny, nm);
+	for (int j = 0; j < nm; j++)
+		mask_lap[j] = &mask_data[nm * j];
+	set_mask(dx, dy, code, mask_lap, nm);
+	spectral_init(mask_lap, code, dx, dy, nx, ny, nm);
+	start_writer(nx, ny, nm, dx, dy, unit, WRITER_DEPTH);
+
+	print_progress(step, steps);
+
+	double start_time = GetTimer();
+	apply_initial_conditions(conc_old, nx, ny, nm);
+	watch.step = GetTimer() - start_time;
+
+	/* write initial condition data */
+	start_time = GetTimer();
+	if (restart != NULL)
+		read_checkpoint(restart, conc_old, nx, ny, nm, dx, dy, &step, &elapsed);
+	const int start = step;
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
+
+	/* prepare to log comparison to analytical solution, continuing the old log on restart */
+	output = fopen("runlog.csv", (restart == NULL) ? "w" : "a");
+	if (output == NULL) {
+		printf("Error: unable to %s for output. Check permissions.\n", "runlog.csv");
+		exit(-1);
+	}
+	watch.file = GetTimer() - start_time;
+
+	if (restart == NULL) {
+		fprintf(output, "iter,sim_time,energy,conv_time,step_time,IO_time,run_time\n");
+		energy = nx*dx * ny*dy * chem_energy(0.5);
+	} else {
+		apply_boundary_conditions(conc_old, nx, ny, nm);
+		free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy);
+	}
+	fprintf(output, "# spectral dt=%f, %d explicit steps per step\n", dt, scale);
+	fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
+			watch.conv, watch.step, watch.file, GetTimer());
+	fflush(output);
+
+	#ifdef ADAPTIVE
+	/* Steps of any length, starting from scale explicit steps, each kept only
+	   if the free energy does not rise. Checkpoints still come every checks
+	   explicit steps, which bounds the step. */
+	const int stop = steps;
+	const double loop_start = GetTimer();
+
+	adapt_init(dt, checks * unit, 1, nx, ny, nm);
+	if (restart != NULL && !adapt_resume("runlog.csv", start))
+		printf("Warning: no adaptive step logged for step %i. Starting over from %e.\n", start, dt);
+
+	apply_boundary_conditions(conc_old, nx, ny, nm);
+	free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy);
+
+	for (step = start; step < stop; ) {
+		const int next = (step / checks + 1) * checks;
+		const int last = (next < stop) ? next : stop;
+		const fp_t t_stop = elapsed + (last - step) * unit;
+
+		while (t_stop - elapsed > 1.0e-6 * unit) {
+			fp_t energy_new;
+
+			adapt_save(conc_old, elapsed);
+
+			for (int n = 0; n < adapt_interval() && t_stop - elapsed > 1.0e-6 * unit; n++) {
+				const fp_t h = adapt_dt(t_stop - elapsed);
+
+				/* === Start Architecture-Specific Kernel === */
+				start_time = GetTimer();
+				compute_spectral_transform(conc_old, nx, ny, nm);
+				watch.conv += GetTimer() - start_time;
+
+				start_time = GetTimer();
+				update_spectral_composition(conc_new, nx, ny, nm, M, kappa, h);
+				watch.step += GetTimer() - start_time;
+
+				swap_pointers(&conc_old, &conc_new);
+				apply_boundary_conditions(conc_old, nx, ny, nm);
+				elapsed += h;
+				/* === Finish Architecture-Specific Kernel === */
+			}
+
+			start_time = GetTimer();
+			free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy_new);
+			if (adapt_accept(conc_old, energy, energy_new, &elapsed))
+				energy = energy_new;
+			watch.step += GetTimer() - start_time;
+		}
+
+		elapsed = t_stop;
+		step = last;
+		print_progress(step, steps);
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
+					watch.conv, watch.step, watch.file, GetTimer());
+			adapt_log(output);
+			fflush(output);
+		}
+	}
+	adapt_free();
+
+	if (stop > start)
+		fprintf(output, "# %d steps, %.3f us/step\n", stop - start,
+		        1.0e6 * (GetTimer() - loop_start) / (stop - start));
+	#else
+	/* do the work, stopping short of steps if the last stride would pass it */
+	const int stop = start + (steps - start) / scale * scale;
+	const double loop_start = GetTimer();
+
+	for (step = start+scale; step < stop+1; step += scale) {
+		print_progress(step, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		start_time = GetTimer();
+		compute_spectral_transform(conc_old, nx, ny, nm);
+		watch.conv += GetTimer() - start_time;
+
+		start_time = GetTimer();
+		update_spectral_composition(conc_new, nx, ny, nm, M, kappa, dt);
+		watch.step += GetTimer() - start_time;
+
+		swap_pointers(&conc_old, &conc_new);
+		elapsed += dt;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			apply_boundary_conditions(conc_old, nx, ny, nm);
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			free_energy(conc_old, dx, dy, nx, ny, nm, kappa, &energy);
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
+					watch.conv, watch.step, watch.file, GetTimer());
+			fflush(output);
+		}
+	}
+
+	if (stop > start)
+		fprintf(output, "# %d steps, %.3f us/step\n", (stop - start) / scale,
+		        1.0e6 * scale * (GetTimer() - loop_start) / (stop - start));
+	#endif
+
+	apply_boundary_conditions(conc_old, nx, ny, nm);
+	queue_output(conc_old, WRITE_CSV, stop, elapsed);
+
+	/* clean up */
+	stop_writer();
+	fclose(output);
+	spectral_free();
+	free_field(conc_old);
+	free_field(conc_new);
+
+	return 0;
+}
@@ -9,16 +9,68 @@
 */
 
 #include <math.h>
+#include <string.h>
+#include <vector>
 #include <tbb/tbb.h>
-#include <tbb/task_scheduler_init.h>
 #include <tbb/parallel_for.h>
-#include <tbb/parallel_reduce.h>
 #include <tbb/blocked_range2d.h>
+#include "affinity.h"
 #include "boundaries.h"
 #include "mesh.h"
 #include "numerics.h"
 #include "timer.h"
 
+/**
+ \brief Pin each TBB thread as it joins the arena, using its arena slot
+*/
+class ThreadPinner : public tbb::task_scheduler_observer
+{
+public:
+	ThreadPinner()
+	{
+		observe(true);
+	}
+
+	void on_scheduler_entry(bool)
+	{
+		pin_thread(tbb::this_task_arena::current_thread_index());
+	}
+};
+
+void pin_threads_lambda()
+{
+	static ThreadPinner* pinner = NULL;
+
+	affinity_init();
+	if (pinner == NULL)
+		pinner = new ThreadPinner;
+}
+
+void first_touch_lambda(fp_t** field, const int nx, const int ny, const int nm)
+{
+	const size_t row = (size_t)mesh_pitch(nx) * sizeof(fp_t);
+
+	/* Lambda function executed on each thread, touching the tiles it will update */
+	tbb::parallel_for(tbb::blocked_range2d<int>(nm/2, nx-nm/2, nm/2, ny-nm/2),
+		[=](const tbb::blocked_range2d<int>& r) {
+			for (int j = r.cols().begin(); j != r.cols().end(); j++) {
+				memset(&field[j][r.rows().begin()], 0, (r.rows().end() - r.rows().begin()) * sizeof(fp_t));
+			}
+		},
+		tbb::static_partitioner()
+	);
+
+	/* halo rows, plus halo columns and padding of interior rows */
+	for (int j = 0; j < nm/2; j++) {
+		memset(field[j], 0, row);
+		memset(field[ny-1-j], 0, row);
+	}
+	for (int j = nm/2; j < ny-nm/2; j++) {
+		memset(field[j], 0, (nm/2) * sizeof(fp_t));
+		memset(&field[j][nx-nm/2], 0, row - (nx-nm/2) * sizeof(fp_t));
+	}
+}
+
 void compute_convolution(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
                          const int nx, const int ny, const int nm)
 {
@@ -26,17 +78,10 @@ void compute_convolution(fp_t** conc_old, fp_t** conc_lap, fp_t** mask_lap,
 	tbb::parallel_for(tbb::blocked_range2d<int>(nm/2, nx-nm/2, nm/2, ny-nm/2),
 		[=](const tbb::blocked_range2d<int>& r) {
 			for (int j = r.cols().begin(); j != r.cols().end(); j++) {
-				for (int i = r.rows().begin(); i != r.rows().end(); i++) {
-					fp_t value = 0.0;
-					for (int mj = -nm/2; mj < nm/2+1; mj++) {
-						for (int mi = -nm/2; mi < nm/2+1; mi++) {
-							value += mask_lap[mj+nm/2][mi+nm/2] * conc_old[j+mj][i+mi];
-						}
-					}
-					conc_lap[j][i] = value;
-				}
+				convolve_row(conc_old, conc_lap[j], mask_lap, j, r.rows().begin(), r.rows().end(), nm);
 			}
-		}
+		},
+		tbb::static_partitioner()
 	);
 }
 
@@ -52,76 +97,125 @@ void update_composition(fp_t** conc_old, fp_t** conc_lap, fp_t** conc_new,
 					conc_new[j][i] = conc_old[j][i] + dt * D * conc_lap[j][i];
 				}
 			}
-		}
+		},
+		tbb::static_partitioner()
 	);
 }
 
-void check_solution_lambda(fp_t** conc_new, fp_t** conc_lap, const int nx, const int ny,
-						   const fp_t dx, const fp_t dy, const int nm, const fp_t elapsed, const fp_t D,
-						   fp_t* rss)
+void update_stage(fp_t** conc_old, fp_t** lap_old, fp_t** stage_1, fp_t** stage_2,
+                  fp_t** conc_lap, fp_t** stage, const int nx, const int ny, const int nm,
+                  const fp_t mu, const fp_t nu, const fp_t mu_dt, const fp_t gamma_dt)
 {
-	/* Note: tbb::parallel_reduce can only operate on a blocked_range, */
-	/* *not* a blocked_range2d. This requires some creativity to get around. */
-
-	/* Lambda function executed on each thread, zeroing conc_lap */
-	tbb::parallel_for
-	(
-		tbb::blocked_range2d<int>(0, nx, 0, ny),
+	/* Lambda function executed on each thread, updating one Runge-Kutta-Legendre stage */
+	tbb::parallel_for(tbb::blocked_range2d<int>(nm/2, nx-nm/2, nm/2, ny-nm/2),
 		[=](const tbb::blocked_range2d<int>& r) {
 			for (int j = r.cols().begin(); j != r.cols().end(); j++) {
 				for (int i = r.rows().begin(); i != r.rows().end(); i++) {
-					conc_lap[j][i] = 0.;
+					stage[j][i] = mu * stage_1[j][i] + nu * stage_2[j][i] + (1. - mu - nu) * conc_old[j][i]
+					            + mu_dt * conc_lap[j][i] + gamma_dt * lap_old[j][i];
 				}
 			}
-		}
+		},
+		tbb::static_partitioner()
 	);
+}
+
+void check_solution_lambda(fp_t** conc_new, const int nx, const int ny,
+						   const fp_t dx, const fp_t dy, const int nm, const fp_t elapsed, const fp_t D,
+						   fp_t* rss, fp_t* rss_err)
+{
+	const int stride = rss_stride();
+	const int rows = (ny - 2*(nm/2) + stride - 1) / stride;
+	std::vector<fp_t> sums(ny, 0.), squares(ny, 0.);
 
-	/* Lambda function executed on each thread, checking local values */
+	/* Lambda function executed on each thread, reducing whole sampled rows */
 	tbb::parallel_for
 	(
-		tbb::blocked_range2d<int>(nm/2, nx-nm/2, nm/2, ny-nm/2),
-		[=](const tbb::blocked_range2d<int>& r) {
-			for (int j = r.cols().begin(); j != r.cols().end(); j++) {
-				for (int i = r.rows().begin(); i != r.rows().end(); i++) {
-					fp_t cal, car, r;
-
-					/* numerical solution */
-					const fp_t cn = conc_new[j][i];
+		tbb::blocked_range<int>(0, rows),
+		[&](const tbb::blocked_range<int>& r) {
+			for (int n = r.begin(); n != r.end(); n++) {
+				const int j = nm/2 + n * stride;
+				sums[j] = residual_row(conc_new, j, nx, ny, dx, dy, nm, elapsed, D, stride, &squares[j]);
+			}
+		}
+	);
 
-					/* shortest distance to left-wall source */
-					r = distance_point_to_segment(dx * (nm/2), dy * (nm/2),
-					                              dx * (nm/2), dy * (ny/2),
-					                              dx * i, dy * j);
-					analytical_value(r, elapsed, D, &cal);
+	/* add rows in order, so the sum matches the serial and OpenMP builds */
+	sampled_rss(sums.data(), squares.data(), nx, ny, nm, stride, rss, rss_err);
+}
 
-					/* shortest distance to right-wall source */
-					r = distance_point_to_segment(dx * (nx-1-nm/2), dy * (ny/2),
-					                              dx * (nx-1-nm/2), dy * (ny-1-nm/2),
-					                              dx * i, dy * j);
-					analytical_value(r, elapsed, D, &car);
+void cg_start(fp_t** conc_old, fp_t** conc_lap, fp_t** x, fp_t** r, fp_t** dinv, fp_t* rows,
+              const int nx, const int ny, const int nm, const fp_t a)
+{
+	/* Lambda function executed on each thread, summing whole rows */
+	tbb::parallel_for(tbb::blocked_range<int>(nm/2, ny-nm/2),
+		[=](const tbb::blocked_range<int>& range) {
+			for (int j = range.begin(); j != range.end(); j++) {
+				fp_t sum = 0.;
+				for (int i = nm/2; i < nx-nm/2; i++) {
+					const fp_t unknown = (dinv[j][i] != 0.) ? 1. : 0.;
+					x[j][i] = unknown * conc_old[j][i];
+					r[j][i] = unknown * a * conc_lap[j][i];
+					sum += r[j][i] * dinv[j][i] * r[j][i];
+				}
+				rows[j] = sum;
+			}
+		},
+		tbb::static_partitioner()
+	);
+}
 
-					/* superposition of analytical solutions */
-					const fp_t ca = cal + car;
+void cg_apply(fp_t** p, fp_t** q, fp_t** mask_lap, fp_t* rows,
+              const int nx, const int ny, const int nm, const fp_t a)
+{
+	/* Lambda function executed on each thread, finishing each row while its convolution is in cache */
+	tbb::parallel_for(tbb::blocked_range<int>(nm/2, ny-nm/2),
+		[=](const tbb::blocked_range<int>& range) {
+			for (int j = range.begin(); j != range.end(); j++) {
+				fp_t sum = 0.;
+				convolve_row(p, q[j], mask_lap, j, nm/2, nx-nm/2, nm);
+				for (int i = nm/2; i < nx-nm/2; i++) {
+					q[j][i] = p[j][i] - a * q[j][i];
+					sum += p[j][i] * q[j][i];
+				}
+				rows[j] = sum;
+			}
+		},
+		tbb::static_partitioner()
+	);
+}
 
-					/* residual sum of squares (RSS) */
-					conc_lap[j][i] = (ca - cn) * (ca - cn) / (fp_t)((nx-1-nm/2) * (ny-1-nm/2));
+void cg_update(fp_t** x, fp_t** r, fp_t** p, fp_t** q, fp_t** dinv, fp_t* rows,
+               const int nx, const int ny, const int nm, const fp_t alpha)
+{
+	/* Lambda function executed on each thread, summing whole rows */
+	tbb::parallel_for(tbb::blocked_range<int>(nm/2, ny-nm/2),
+		[=](const tbb::blocked_range<int>& range) {
+			for (int j = range.begin(); j != range.end(); j++) {
+				fp_t sum = 0.;
+				for (int i = nm/2; i < nx-nm/2; i++) {
+					x[j][i] += alpha * p[j][i];
+					r[j][i] -= alpha * q[j][i];
+					sum += r[j][i] * dinv[j][i] * r[j][i];
 				}
+				rows[j] = sum;
 			}
-		}
+		},
+		tbb::static_partitioner()
 	);
+}
 
-	/* Lambda function executed on each thread, summing up the vector */
-	*rss = tbb::parallel_reduce
-	(
-		tbb::blocked_range<fp_t*>(conc_lap[0], conc_lap[0] + nx*ny), 0.,
-		[](const tbb::blocked_range<fp_t*>& r, fp_t sum)->fp_t {
-			for (fp_t* p = r.begin(); p != r.end(); p++) {
-				sum += *p;
+void cg_direction(fp_t** p, fp_t** r, fp_t** dinv,
+                  const int nx, const int ny, const int nm, const fp_t beta)
+{
+	/* Lambda function executed on each thread, updating the search direction */
+	tbb::parallel_for(tbb::blocked_range<int>(nm/2, ny-nm/2),
+		[=](const tbb::blocked_range<int>& range) {
+			for (int j = range.begin(); j != range.end(); j++) {
+				for (int i = nm/2; i < nx-nm/2; i++)
+					p[j][i] = dinv[j][i] * r[j][i] + beta * p[j][i];
 			}
-			return sum;
 		},
-		[](fp_t x, fp_t y)->fp_t {
-			return x+y;
-		}
+		tbb::static_partitioner()
 	);
 }
@@ -13,15 +13,25 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <tbb/task_arena.h>
+
+#include "affinity.h"
 #include "boundaries.h"
+#include "implicit.h"
 #include "mesh.h"
 #include "numerics.h"
 #include "output.h"
+#include "rkl.h"
 #include "timer.h"
+#include "writer.h"
 
-void check_solution_lambda(fp_t** conc_new, fp_t** conc_lap, const int nx, const int ny,
+void check_solution_lambda(fp_t** conc_new, const int nx, const int ny,
 						   const fp_t dx, const fp_t dy, const int nm, const fp_t elapsed, const fp_t D,
-						   fp_t* rss);
+						   fp_t* rss, fp_t* rss_err);
+
+void pin_threads_lambda();
+
+void first_touch_lambda(fp_t** field, const int nx, const int ny, const int nm);
 
 /**
  \brief Run simulation using input parameters specified on the command line
@@ -36,47 +46,168 @@ int main(int argc, char* argv[])
 	fp_t dx=0.5, dy=0.5, h;
 
 	/* declare default materials and numerical parameters */
-	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0.;
+	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0., rss_err=0.;
 	int step=0, steps=100000, checks=10000;
 	double start_time=0.;
 	struct Stopwatch watch = {0., 0., 0., 0.};
 
 	StartTimer();
 
-	param_parser(argc, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab, &nm, &nx, &ny, &steps);
+	/* an optional second argument names a checkpoint to restart from */
+	const char* restart = (argc == 3) ? argv[2] : NULL;
+
+	param_parser((restart == NULL) ? argc : 2, argv, &bx, &by, &checks, &code, &D, &dx, &dy, &linStab, &nm, &nx, &ny, &steps);
 
 	h = (dx > dy) ? dy : dx;
 	dt = (linStab * h * h) / (4.0 * D);
 
+	/* pin threads before first touch, so pages land beside their threads */
+	pin_threads_lambda();
+	if (getenv("HIPERC_TOUCH") == NULL || strcmp(getenv("HIPERC_TOUCH"), "serial") != 0)
+		set_first_touch(first_touch_lambda);
+
 	/* initialize memory */
 	make_arrays(&conc_old, &conc_new, &conc_lap, &mask_lap, nx, ny, nm);
 	set_mask(dx, dy, code, mask_lap, nm);
+	start_writer(nx, ny, nm, dx, dy, WRITER_DEPTH);
 
 	print_progress(step, steps);
 
 	start_time = GetTimer();
 	apply_initial_conditions(conc_old, nx, ny, nm);
+	if (restart != NULL)
+		read_checkpoint(restart, conc_old, nx, ny, nm, dx, dy, &step, &elapsed);
+	const int start = step;
 	watch.step = GetTimer() - start_time;
 
 	/* write initial condition data */
 	start_time = GetTimer();
-	write_png(conc_old, nx, ny, 0);
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
 
-	/* prepare to log comparison to analytical solution */
-	output = fopen("runlog.csv", "w");
+	/* prepare to log comparison to analytical solution, continuing the old log on restart */
+	output = fopen("runlog.csv", (restart == NULL) ? "w" : "a");
 	if (output == NULL) {
 		printf("Error: unable to %s for output. Check permissions.\n", "runlog.csv");
 		exit(-1);
 	}
 	watch.file = GetTimer() - start_time;
 
-	fprintf(output, "iter,sim_time,wrss,conv_time,step_time,IO_time,soln_time,run_time\n");
-	fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
-			watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+	if (restart == NULL) {
+		fprintf(output, "iter,sim_time,wrss,conv_time,step_time,IO_time,soln_time,run_time\n");
+		fprintf(output, "# %s %s threads=%d\n", mesh_placement(), thread_placement(),
+		        tbb::this_task_arena::max_concurrency());
+		fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+				watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+	}
 	fflush(output);
 
+	#if defined(IMPLICIT)
+	/* each implicit step spans scale explicit steps, which must divide the checkpoint interval */
+	int scale = 10;
+	if (getenv("HIPERC_DT_SCALE") != NULL)
+		scale = atoi(getenv("HIPERC_DT_SCALE"));
+	if (scale < 1)
+		scale = 1;
+	while (checks % scale != 0)
+		scale--;
+
+	/* stop short of steps if the last stride would pass it */
+	steps = start + (steps - start) / scale * scale;
+	dt *= scale;
+
+	implicit_init(mask_lap, code, dx, dy, nx, ny, nm, D, dt, implicit_theta());
+	fprintf(output, "# implicit theta=%.1f dt=%f, %d explicit steps per step\n", implicit_theta(), dt, scale);
+
+	/* Steps, checkpoints, and file names still count explicit steps, so the
+	   log lines up with the explicit builds'. */
+	long iters = 0;
+
+	for (step = start+scale; step < steps+1; step += scale) {
+		print_progress(step, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		apply_boundary_conditions(conc_old, nx, ny, nm);
+
+		start_time = GetTimer();
+		compute_convolution(conc_old, conc_lap, mask_lap, nx, ny, nm);
+		watch.conv += GetTimer() - start_time;
+
+		start_time = GetTimer();
+		iters += implicit_step(conc_old, conc_lap, conc_new, mask_lap, nx, ny, nm);
+		watch.step += GetTimer() - start_time;
+
+		swap_pointers(&conc_old, &conc_new);
+		elapsed += dt;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			start_time = GetTimer();
+			check_solution_lambda(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+			watch.soln += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
+			fprintf(output, "# cg iterations/step=%.1f\n", (double)(iters * scale) / checks);
+			fflush(output);
+			iters = 0;
+		}
+	}
+	implicit_free();
+	#elif defined(RKL2)
+	/* each super-step spans scale explicit steps, which must divide the checkpoint
+	   interval: as many as keep every mode accurate, unless told otherwise */
+	int scale = (getenv("HIPERC_DT_SCALE") != NULL) ? atoi(getenv("HIPERC_DT_SCALE"))
+	                                                : rkl_scale(mask_lap, nm, D, dt, checks);
+	if (scale < 1)
+		scale = 1;
+	while (checks % scale != 0)
+		scale--;
+
+	/* stop short of steps if the last stride would pass it */
+	steps = start + (steps - start) / scale * scale;
+	dt *= scale;
+
+	rkl_init(mask_lap, nx, ny, nm, D, dt);
+	fprintf(output, "# rkl2 dt=%f, %d stages, %d explicit steps per step\n", dt, rkl_stages(), scale);
+
+	/* Steps, checkpoints, and file names still count explicit steps, so the
+	   log lines up with the explicit builds'. */
+	for (step = start+scale; step < steps+1; step += scale) {
+		print_progress(step, steps);
+
+		/* === Start Architecture-Specific Kernel === */
+		rkl_step(conc_old, conc_lap, conc_new, mask_lap, nx, ny, nm, &watch);
+
+		swap_pointers(&conc_old, &conc_new);
+		elapsed += dt;
+		/* === Finish Architecture-Specific Kernel === */
+
+		if (step % checks == 0) {
+			start_time = GetTimer();
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
+			watch.file += GetTimer() - start_time;
+
+			start_time = GetTimer();
+			check_solution_lambda(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
+			watch.soln += GetTimer() - start_time;
+
+			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
+					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
+			fflush(output);
+		}
+	}
+	rkl_free();
+	#else
 	/* do the work */
-	for (step = 1; step < steps + 1; step++) {
+	for (step = start+1; step < steps + 1; step++) {
 		print_progress(step, steps);
 
 		/* === Start Architecture-Specific Kernel === */
@@ -96,22 +227,27 @@ int main(int argc, char* argv[])
 
 		if (step % checks == 0) {
 			start_time = GetTimer();
-			write_png(conc_old, nx, ny, step);
+			queue_output(conc_old, WRITE_PNG | WRITE_CHECKPOINT, step, elapsed);
 			watch.file += GetTimer() - start_time;
 
 			start_time = GetTimer();
-			check_solution_lambda(conc_old, conc_lap, nx, ny, dx, dy, nm, elapsed, D, &rss);
+			check_solution_lambda(conc_old, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
 			watch.soln += GetTimer() - start_time;
 
 			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
 					watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
 			fflush(output);
 		}
 	}
 
-	write_csv(conc_old, nx, ny, dx, dy, steps);
+	#endif
+
+	queue_output(conc_old, WRITE_CSV, steps, elapsed);
 
 	/* clean up */
+	stop_writer();
 	fclose(output);
 	free_arrays(conc_old, conc_new, conc_lap, mask_lap);
 
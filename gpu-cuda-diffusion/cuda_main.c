@@ -20,6 +20,7 @@
 #include "numerics.h"
 #include "output.h"
 #include "timer.h"
+#include "writer.h"
 
 /* specific includes */
 #include "cuda_data.h"
@@ -37,7 +38,7 @@ int main(int argc, char* argv[])
 	fp_t dx=0.5, dy=0.5, h;
 
 	/* declare default materials and numerical parameters */
-	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0.;
+	fp_t D=0.00625, linStab=0.1, dt=1., elapsed=0., rss=0., rss_err=0.;
 	int step=0, steps=100000, checks=10000;
 	double start_time=0.;
 	struct Stopwatch watch = {0., 0., 0., 0.};
@@ -52,6 +53,7 @@ int main(int argc, char* argv[])
 	/* initialize memory */
 	make_arrays(&conc_old, &conc_new, &conc_lap, &mask_lap, nx, ny, nm);
 	set_mask(dx, dy, code, mask_lap, nm);
+	start_writer(nx, ny, nm, dx, dy, WRITER_DEPTH);
 
 	print_progress(step, steps);
 
@@ -65,7 +67,7 @@ int main(int argc, char* argv[])
 
 	/* write initial condition data */
 	start_time = GetTimer();
-	write_png(conc_old, nx, ny, 0);
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
 
 	/* prepare to log comparison to analytical solution */
 	output = fopen("runlog.csv", "w");
@@ -107,22 +109,25 @@ int main(int argc, char* argv[])
 			watch.file += GetTimer() - start_time;
 
 			start_time = GetTimer();
-			write_png(conc_new, nx, ny, step);
+			queue_output(conc_new, WRITE_PNG, step, elapsed);
 			watch.file += GetTimer() - start_time;
 
 			start_time = GetTimer();
-			check_solution(conc_new, conc_lap, nx, ny, dx, dy, nm, elapsed, D, &rss);
+			check_solution(conc_new, nx, ny, dx, dy, nm, elapsed, D, &rss, &rss_err);
 			watch.soln += GetTimer() - start_time;
 
 			fprintf(output, "%i,%f,%f,%f,%f,%f,%f,%f\n", step, elapsed, rss,
 			        watch.conv, watch.step, watch.file, watch.soln, GetTimer());
+			if (rss_err > 0.)
+				fprintf(output, "# wrss_err=%e\n", rss_err);
 			fflush(output);
 		}
 	}
 
-	write_csv(conc_new, nx, ny, dx, dy, steps);
+	queue_output(conc_new, WRITE_CSV, steps, elapsed);
 
 	/* clean up */
+	stop_writer();
 	fclose(output);
 	free_arrays(conc_old, conc_new, conc_lap, mask_lap);
 	free_cuda(&dev);
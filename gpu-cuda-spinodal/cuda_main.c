@@ -20,6 +20,7 @@
 #include "numerics.h"
 #include "output.h"
 #include "timer.h"
+#include "writer.h"
 
 /* specific includes */
 #include "cuda_data.h"
@@ -50,6 +51,7 @@ int main(int argc, char* argv[])
 	/* initialize memory */
 	make_arrays(&conc_old, &conc_new, &conc_lap, &conc_div, &mask_lap, nx, ny, nm);
 	set_mask(dx, dy, code, mask_lap, nm);
+	start_writer(nx, ny, nm, dx, dy, dt, WRITER_DEPTH);
 
 	print_progress(step, steps);
 
@@ -63,7 +65,7 @@ int main(int argc, char* argv[])
 
 	/* write initial condition data */
 	start_time = GetTimer();
-	write_png(conc_old, nx, ny, 0);
+	queue_output(conc_old, WRITE_PNG, step, elapsed);
 
 	/* prepare to log comparison to analytical solution */
 	output = fopen("runlog.csv", "w");
@@ -110,10 +112,10 @@ int main(int argc, char* argv[])
 			read_out_result(conc_new, dev.conc_old, nx, ny);
 			watch.file += GetTimer() - start_time;
 
-			free_energy(conc_new, conc_lap, dx, dy, nx, ny, nm, kappa, &energy);
+			free_energy(conc_new, dx, dy, nx, ny, nm, kappa, &energy);
 
 			start_time = GetTimer();
-			write_png(conc_new, nx, ny, dt * step);
+			queue_output(conc_new, WRITE_PNG, step, elapsed);
 			watch.file += GetTimer() - start_time;
 
 			fprintf(output, "%i,%f,%f,%f,%f,%f,%f\n", step, elapsed, energy,
@@ -122,9 +124,10 @@ int main(int argc, char* argv[])
 		}
 	}
 
-	write_csv(conc_new, nx, ny, dx, dy, dt * steps);
+	queue_output(conc_new, WRITE_CSV, steps, elapsed);
 
 	/* clean up */
+	stop_writer();
 	fclose(output);
 	free_arrays(conc_old, conc_new, conc_lap, conc_div, mask_lap);
 	free_cuda(&dev);